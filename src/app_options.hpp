@@ -0,0 +1,216 @@
+#pragma once
+#include <cctype>
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include <string>
+#include "thread_pool/thread_pool.hpp"
+
+
+// Command line options of the executable
+struct AppOptions
+{
+    // The solver runs on its own thread, one frame ahead of the renderer
+    bool  pipelined  = false;
+    // The solver runs on its own thread at a fixed rate, presentation is interpolated
+    bool  fixed_step = false;
+    float sim_rate   = 60.0f;
+    // State file loaded at startup, if any, and written when pressing F5
+    std::string load_path;
+    std::string save_path = "state.bin";
+    // Trajectory file written during the run, if any
+    std::string record_path;
+    // Trajectory file played instead of running the solver
+    std::string replay_path;
+    // Frames are served to external viewers on a Unix socket, or else on a localhost TCP port
+    std::string broadcast_path;
+    uint16_t    broadcast_port = 0;
+    // Shared memory object where positions are exported after each update, if any
+    std::string export_name;
+    // Prometheus metrics served on a Unix socket, or else on a localhost TCP port
+    std::string metrics_path;
+    uint16_t    metrics_port = 0;
+    // Thread pool trace written when pressing T, covering trace_frames frames
+    std::string trace_path   = "trace.json";
+    uint32_t    trace_frames = 10;
+    // Profiler scopes also read hardware counters, only with VERLET_PROFILING
+    bool        perf_counters  = false;
+    // Parallel layout loaded from the tuning cache, calibrated first if missing or if retune is set
+    bool        auto_tune         = false;
+    bool        retune            = false;
+    std::string tuning_cache_path = "tuning.cache";
+    // Emission stops when solving and rendering take more than this, 0 is one frame at the frame
+    // rate cap. Without it, emission only stops at the world's capacity.
+    bool        frame_budget    = true;
+    float       frame_budget_ms = 0.0f;
+    // Workers pinning, with stable ownership of grid stripes and objects
+    tp::Affinity affinity = tp::Affinity::None;
+    // Runs the headless thread count and density sweep instead of the simulation, its rows are
+    // also written as JSON if a path is given
+    bool        scaling_report = false;
+    std::string scaling_json_path;
+    // Cleared when a value is malformed or out of range, the usage has then been printed
+    bool        valid          = true;
+
+    static AppOptions parse(int argc, char** argv)
+    {
+        AppOptions options;
+        for (int32_t i{1}; i < argc; ++i) {
+            const std::string arg = argv[i];
+            if (arg == "--pipelined") {
+                options.pipelined = true;
+            } else if (arg == "--fixed-step") {
+                options.fixed_step = true;
+            } else if (arg == "--sim-rate" && i + 1 < argc) {
+                // The fixed time step is 1 / sim_rate
+                options.valid = parseFloat(arg, argv[++i], false, options.sim_rate);
+            } else if (arg == "--load" && i + 1 < argc) {
+                options.load_path = argv[++i];
+            } else if (arg == "--save" && i + 1 < argc) {
+                options.save_path = argv[++i];
+            } else if (arg == "--record" && i + 1 < argc) {
+                options.record_path = argv[++i];
+            } else if (arg == "--replay" && i + 1 < argc) {
+                options.replay_path = argv[++i];
+            } else if (arg == "--broadcast" && i + 1 < argc) {
+                options.broadcast_path = argv[++i];
+            } else if (arg == "--broadcast-port" && i + 1 < argc) {
+                options.valid = parsePort(arg, argv[++i], options.broadcast_port);
+            } else if (arg == "--export" && i + 1 < argc) {
+                options.export_name = argv[++i];
+            } else if (arg == "--metrics" && i + 1 < argc) {
+                options.metrics_path = argv[++i];
+            } else if (arg == "--metrics-port" && i + 1 < argc) {
+                options.valid = parsePort(arg, argv[++i], options.metrics_port);
+            } else if (arg == "--trace" && i + 1 < argc) {
+                options.trace_path = argv[++i];
+            } else if (arg == "--trace-frames" && i + 1 < argc) {
+                options.valid = parseUnsigned(arg, argv[++i], 1, std::numeric_limits<uint32_t>::max(), options.trace_frames);
+            } else if (arg == "--perf-counters") {
+                options.perf_counters = true;
+            } else if (arg == "--auto-tune") {
+                options.auto_tune = true;
+            } else if (arg == "--retune") {
+                options.auto_tune = true;
+                options.retune    = true;
+            } else if (arg == "--tuning-cache" && i + 1 < argc) {
+                options.tuning_cache_path = argv[++i];
+            } else if (arg == "--frame-budget" && i + 1 < argc) {
+                options.valid = parseFloat(arg, argv[++i], true, options.frame_budget_ms);
+            } else if (arg == "--no-frame-budget") {
+                options.frame_budget = false;
+            } else if (arg == "--affinity" && i + 1 < argc) {
+                const std::string value = argv[++i];
+                if (value == "cores") {
+                    options.affinity = tp::Affinity::Cores;
+                } else if (value == "nodes") {
+                    options.affinity = tp::Affinity::Nodes;
+                } else if (value != "none") {
+                    std::cout << "Unknown affinity " << value << ", expected none, cores or nodes" << std::endl;
+                    options.valid = false;
+                }
+            } else if (arg == "--scaling-report") {
+                options.scaling_report = true;
+            } else if (arg == "--scaling-json" && i + 1 < argc) {
+                options.scaling_report    = true;
+                options.scaling_json_path = argv[++i];
+            } else {
+                std::cout << "Unknown option " << arg << std::endl;
+            }
+            if (!options.valid) {
+                printUsage();
+                return options;
+            }
+        }
+        return options;
+    }
+
+    static void printUsage()
+    {
+        std::cout << "Usage: Verlet-Multithread [options]\n"
+                     "  --pipelined                  solve on its own thread, one frame ahead of the renderer\n"
+                     "  --fixed-step                 solve on its own thread at a fixed rate\n"
+                     "  --sim-rate <updates/s>       rate of the fixed step, positive, default 60\n"
+                     "  --load <file>                state file loaded at startup\n"
+                     "  --save <file>                state file written when pressing F5\n"
+                     "  --record <file>              trajectory recorded during the run\n"
+                     "  --replay <file>              trajectory played instead of the simulation\n"
+                     "  --broadcast <socket>         frames served on a Unix socket\n"
+                     "  --broadcast-port <port>      frames served on a localhost TCP port\n"
+                     "  --export <name>              shared memory export of the positions\n"
+                     "  --metrics <socket>           Prometheus metrics served on a Unix socket\n"
+                     "  --metrics-port <port>        Prometheus metrics served on a localhost TCP port\n"
+                     "  --trace <file>               thread pool trace written when pressing T\n"
+                     "  --trace-frames <count>       frames covered by a trace, positive, default 10\n"
+                     "  --perf-counters              hardware counters in the profiler\n"
+                     "  --auto-tune, --retune        parallel layout from the tuning cache, calibrated if missing\n"
+                     "  --tuning-cache <file>        tuning cache, default tuning.cache\n"
+                     "  --frame-budget <ms>          emission stops above this frame time, 0 is the frame rate cap\n"
+                     "  --no-frame-budget            emission only stops at the world's capacity\n"
+                     "  --affinity none|cores|nodes  workers pinning\n"
+                     "  --scaling-report             thread count and density sweep instead of the simulation\n"
+                     "  --scaling-json <file>        same sweep, rows also written as JSON"
+                  << std::endl;
+    }
+
+    [[nodiscard]]
+    bool threadedSimulation() const
+    {
+        return pipelined || fixed_step;
+    }
+
+private:
+    static void printInvalid(const std::string& option, const std::string& value, const std::string& expected)
+    {
+        std::cout << "Invalid value '" << value << "' for " << option << ", expected " << expected << std::endl;
+    }
+
+    // The whole value has to be a finite positive number, or 0 if allowed
+    static bool parseFloat(const std::string& option, const std::string& value, bool allow_zero, float& result)
+    {
+        std::size_t end    = 0;
+        float       parsed = 0.0f;
+        try {
+            parsed = std::stof(value, &end);
+        } catch (const std::exception&) {
+            end = 0;
+        }
+        if (end == 0 || end != value.size() || !std::isfinite(parsed) || parsed < 0.0f || (parsed == 0.0f && !allow_zero)) {
+            printInvalid(option, value, allow_zero ? "a positive number or 0" : "a positive number");
+            return false;
+        }
+        result = parsed;
+        return true;
+    }
+
+    // Digits only, std::stoul would accept a sign and wrap negative values
+    static bool parseUnsigned(const std::string& option, const std::string& value, uint64_t min, uint64_t max, uint32_t& result)
+    {
+        bool digits = !value.empty();
+        for (const char c : value) {
+            digits = digits && std::isdigit(static_cast<unsigned char>(c));
+        }
+        uint64_t parsed = 0;
+        try {
+            parsed = digits ? std::stoull(value) : 0;
+        } catch (const std::exception&) {
+            digits = false;
+        }
+        if (!digits || parsed < min || parsed > max) {
+            printInvalid(option, value, "an integer from " + std::to_string(min) + " to " + std::to_string(max));
+            return false;
+        }
+        result = static_cast<uint32_t>(parsed);
+        return true;
+    }
+
+    static bool parsePort(const std::string& option, const std::string& value, uint16_t& result)
+    {
+        uint32_t port = 0;
+        if (!parseUnsigned(option, value, 0, std::numeric_limits<uint16_t>::max(), port)) {
+            return false;
+        }
+        result = static_cast<uint16_t>(port);
+        return true;
+    }
+};
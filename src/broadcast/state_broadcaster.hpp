@@ -0,0 +1,345 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+#include "recording/trajectory_codec.hpp"
+#include "simulation/frame_capture.hpp"
+#include "engine/common/triple_buffer.hpp"
+
+#if defined(__unix__) || defined(__APPLE__)
+    #include <arpa/inet.h>
+    #include <fcntl.h>
+    #include <netinet/in.h>
+    #include <poll.h>
+    #include <sys/socket.h>
+    #include <sys/un.h>
+    #include <unistd.h>
+    #define VERLET_BROADCAST_SOCKETS 1
+#endif
+
+
+// Serves the solver's output to external viewers on the same host.
+// After each update the captured frame is handed to the server thread through a triple buffer,
+// the solver never waits for the network. Each client receives a trajectory stream (same
+// format as TrajectoryRecorder's files) delta encoded against the last frame it received.
+// A client that did not consume its previous frame skips the new ones.
+// Clients can limit their rate by sending a uint32 count of frames per second, 0 for all frames.
+class StateBroadcaster
+{
+public:
+    using Clock       = std::chrono::steady_clock;
+    using SharedFrame = FrameCapture::SharedFrame;
+
+    explicit
+    StateBroadcaster(uint32_t keyframe_interval = 60)
+        : m_keyframe_interval{keyframe_interval}
+    {}
+
+    ~StateBroadcaster()
+    {
+        stop();
+    }
+
+    // Listens on a Unix domain socket
+    bool listenUnix(const std::string& path)
+    {
+#ifdef VERLET_BROADCAST_SOCKETS
+        sockaddr_un address{};
+        if (path.size() >= sizeof(address.sun_path)) {
+            std::cerr << "Broadcast socket path " << path << " is too long" << std::endl;
+            return false;
+        }
+        address.sun_family = AF_UNIX;
+        std::copy(path.begin(), path.end(), address.sun_path);
+        unlink(path.c_str());
+        m_socket_path = path;
+        return listenOn(socket(AF_UNIX, SOCK_STREAM, 0), reinterpret_cast<const sockaddr*>(&address), sizeof(address));
+#else
+        std::cerr << "Broadcast is not supported on this platform (" << path << ")" << std::endl;
+        return false;
+#endif
+    }
+
+    // Listens on a localhost TCP port
+    bool listenTcp(uint16_t port)
+    {
+#ifdef VERLET_BROADCAST_SOCKETS
+        sockaddr_in address{};
+        address.sin_family      = AF_INET;
+        address.sin_port        = htons(port);
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        const int32_t fd = socket(AF_INET, SOCK_STREAM, 0);
+        const int32_t reuse = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+        return listenOn(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address));
+#else
+        std::cerr << "Broadcast is not supported on this platform (port " << port << ")" << std::endl;
+        return false;
+#endif
+    }
+
+    // Consumes the frames captured at the end of the solver's updates and starts serving
+    void attach(FrameCapture& capture, Vec2 world_size)
+    {
+        m_world_size = world_size;
+        capture.addConsumer([this](const SharedFrame& frame) {
+            publish(frame);
+        });
+        m_running = true;
+        m_thread  = std::thread([this]{
+            run();
+        });
+    }
+
+    // Called by the thread running the solver, only hands the frame over
+    void publish(const SharedFrame& frame)
+    {
+        if (!m_running) {
+            return;
+        }
+        m_frames.getWriteBuffer() = frame;
+        m_frames.publish();
+#ifdef VERLET_BROADCAST_SOCKETS
+        // Wakes the server up, a full pipe already means a pending wake up
+        const uint8_t signal = 1;
+        [[maybe_unused]] const auto written = write(m_wake_pipe[1], &signal, 1);
+#endif
+    }
+
+    // Also releases the socket of a server that listened but was never attached
+    void stop()
+    {
+        const bool attached = m_thread.joinable();
+        if (attached) {
+            m_running = false;
+            m_thread.join();
+        }
+#ifdef VERLET_BROADCAST_SOCKETS
+        for (Client& client : m_clients) {
+            close(client.fd);
+        }
+        m_clients.clear();
+        for (int32_t* fd : {&m_listen_fd, &m_wake_pipe[0], &m_wake_pipe[1]}) {
+            if (*fd >= 0) {
+                close(*fd);
+                *fd = -1;
+            }
+        }
+        if (!m_socket_path.empty()) {
+            unlink(m_socket_path.c_str());
+            m_socket_path.clear();
+        }
+#endif
+        if (attached) {
+            std::cout << "Broadcast served " << m_clients_count << " clients, " << m_frames_sent << " frames sent, "
+                      << m_frames_dropped << " dropped for slow clients" << std::endl;
+        }
+    }
+
+private:
+    struct Client
+    {
+        int32_t              fd;
+        TrajectoryCodec      codec;
+        // Encoded data not yet accepted by the socket
+        std::vector<uint8_t> pending;
+        uint64_t             pending_offset = 0;
+        uint64_t             frames_sent    = 0;
+        // Minimum time between two frames, 0 for every frame
+        Clock::duration      min_interval   = Clock::duration::zero();
+        Clock::time_point    last_send;
+        // Rate message received so far, it may come in several parts
+        std::array<uint8_t, sizeof(uint32_t)> rate_bytes{};
+        uint32_t             rate_received  = 0;
+        bool                 closed         = false;
+    };
+
+    uint32_t                    m_keyframe_interval;
+    Vec2                        m_world_size;
+    TripleBuffer<SharedFrame>   m_frames;
+
+    std::thread                 m_thread;
+    std::atomic<bool>           m_running   = false;
+    int32_t                     m_listen_fd = -1;
+    int32_t                     m_wake_pipe[2] = {-1, -1};
+    std::string                 m_socket_path;
+    std::vector<Client>         m_clients;
+
+    uint64_t                    m_clients_count  = 0;
+    uint64_t                    m_frames_sent    = 0;
+    uint64_t                    m_frames_dropped = 0;
+
+#ifdef VERLET_BROADCAST_SOCKETS
+    bool listenOn(int32_t fd, const sockaddr* address, socklen_t address_size)
+    {
+        if (fd < 0 || bind(fd, address, address_size) < 0 || listen(fd, 16) < 0 || pipe(m_wake_pipe) < 0) {
+            std::cerr << "Cannot start broadcast server" << std::endl;
+            if (fd >= 0) {
+                close(fd);
+            }
+            return false;
+        }
+        setNonBlocking(fd);
+        setNonBlocking(m_wake_pipe[0]);
+        setNonBlocking(m_wake_pipe[1]);
+        m_listen_fd = fd;
+        return true;
+    }
+
+    static void setNonBlocking(int32_t fd)
+    {
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+    }
+
+    void run()
+    {
+        std::vector<pollfd> poll_fds;
+        while (m_running) {
+            poll_fds.clear();
+            poll_fds.push_back({m_listen_fd, POLLIN, 0});
+            poll_fds.push_back({m_wake_pipe[0], POLLIN, 0});
+            for (const Client& client : m_clients) {
+                const auto events = static_cast<int16_t>(POLLIN | (client.pending.empty() ? 0 : POLLOUT));
+                poll_fds.push_back({client.fd, events, 0});
+            }
+            // The timeout only bounds the time needed to notice a stop request
+            if (poll(poll_fds.data(), static_cast<nfds_t>(poll_fds.size()), 100) < 0) {
+                continue;
+            }
+            if (poll_fds[0].revents & POLLIN) {
+                acceptClients();
+            }
+            for (uint32_t i{0}; i < m_clients.size() && i + 2 < poll_fds.size(); ++i) {
+                const int16_t events = poll_fds[i + 2].revents;
+                Client& client = m_clients[i];
+                if (events & (POLLERR | POLLHUP | POLLNVAL)) {
+                    client.closed = true;
+                    continue;
+                }
+                if (events & POLLIN) {
+                    receiveRate(client);
+                }
+                if (events & POLLOUT) {
+                    flush(client);
+                }
+            }
+            if (poll_fds[1].revents & POLLIN) {
+                uint8_t signals[64];
+                while (read(m_wake_pipe[0], signals, sizeof(signals)) > 0) {}
+                if (m_frames.acquire()) {
+                    broadcast(*m_frames.getReadBuffer());
+                }
+            }
+            removeClosedClients();
+        }
+    }
+
+    void acceptClients()
+    {
+        while (true) {
+            const int32_t fd = accept(m_listen_fd, nullptr, nullptr);
+            if (fd < 0) {
+                return;
+            }
+            setNonBlocking(fd);
+#ifdef SO_NOSIGPIPE
+            const int32_t no_sigpipe = 1;
+            setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &no_sigpipe, sizeof(no_sigpipe));
+#endif
+            Client& client = m_clients.emplace_back();
+            client.fd = fd;
+            TrajectoryCodec::FileHeader header{};
+            header.magic             = TrajectoryCodec::file_magic;
+            header.version           = TrajectoryCodec::version;
+            header.fraction_bits     = TrajectoryCodec::fraction_bits;
+            header.keyframe_interval = m_keyframe_interval;
+            header.world_width       = m_world_size.x;
+            header.world_height      = m_world_size.y;
+            const auto* header_bytes = reinterpret_cast<const uint8_t*>(&header);
+            client.pending.assign(header_bytes, header_bytes + sizeof(header));
+            flush(client);
+            ++m_clients_count;
+        }
+    }
+
+    // Reads until the socket is drained, the last complete rate message applies
+    void receiveRate(Client& client)
+    {
+        while (true) {
+            const auto received = recv(client.fd, client.rate_bytes.data() + client.rate_received,
+                                       client.rate_bytes.size() - client.rate_received, 0);
+            if (received <= 0) {
+                client.closed = received == 0 || (errno != EAGAIN && errno != EWOULDBLOCK);
+                return;
+            }
+            client.rate_received += static_cast<uint32_t>(received);
+            if (client.rate_received == client.rate_bytes.size()) {
+                client.rate_received = 0;
+                uint32_t rate;
+                std::memcpy(&rate, client.rate_bytes.data(), sizeof(rate));
+                client.min_interval = rate ? std::chrono::duration_cast<Clock::duration>(std::chrono::duration<float>(1.0f / to<float>(rate)))
+                                           : Clock::duration::zero();
+            }
+        }
+    }
+
+    void broadcast(const ParticleFrame& frame)
+    {
+        const auto now = Clock::now();
+        for (Client& client : m_clients) {
+            if (client.closed || now - client.last_send < client.min_interval) {
+                continue;
+            }
+            // Slow consumer, the frame is skipped and the next one will be encoded against its last frame
+            if (!client.pending.empty()) {
+                ++m_frames_dropped;
+                continue;
+            }
+            const bool keyframe = (client.frames_sent % m_keyframe_interval) == 0;
+            client.codec.encode(frame, frame.frame_id, keyframe, client.pending);
+            client.last_send = now;
+            ++client.frames_sent;
+            ++m_frames_sent;
+            flush(client);
+        }
+    }
+
+    void flush(Client& client)
+    {
+#ifdef MSG_NOSIGNAL
+        constexpr int32_t flags = MSG_NOSIGNAL;
+#else
+        constexpr int32_t flags = 0;
+#endif
+        while (client.pending_offset < client.pending.size()) {
+            const auto sent = send(client.fd, client.pending.data() + client.pending_offset,
+                                   client.pending.size() - client.pending_offset, flags);
+            if (sent <= 0) {
+                client.closed = sent < 0 && errno != EAGAIN && errno != EWOULDBLOCK;
+                return;
+            }
+            client.pending_offset += static_cast<uint64_t>(sent);
+        }
+        client.pending.clear();
+        client.pending_offset = 0;
+    }
+
+    void removeClosedClients()
+    {
+        for (auto it = m_clients.begin(); it != m_clients.end();) {
+            if (it->closed) {
+                close(it->fd);
+                it = m_clients.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+#else
+    void run() {}
+#endif
+};
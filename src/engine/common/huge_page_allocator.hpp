@@ -0,0 +1,87 @@
+#pragma once
+#include <cstddef>
+#include <new>
+
+#if defined(__linux__)
+    #include <sys/mman.h>
+    #define VERLET_HUGE_PAGES 1
+#endif
+
+
+// Allocator placing large buffers in memory eligible for transparent huge pages.
+// Buffers of at least one huge page are mapped aligned on huge pages, which reduces
+// TLB misses when sweeping them. Smaller buffers, or other platforms, use operator new.
+template<typename T>
+struct HugePageAllocator
+{
+    using value_type = T;
+
+    static constexpr std::size_t huge_page_size = 2 * 1024 * 1024;
+
+    HugePageAllocator() = default;
+
+    template<typename U>
+    HugePageAllocator(const HugePageAllocator<U>&)
+    {}
+
+    T* allocate(std::size_t n)
+    {
+        const std::size_t bytes = n * sizeof(T);
+#ifdef VERLET_HUGE_PAGES
+        if (bytes >= huge_page_size) {
+            // Over map by one huge page to be able to align the block, the excess is given back
+            const std::size_t size    = getMappedSize(bytes);
+            const std::size_t mapping = size + huge_page_size;
+            void* memory = mmap(nullptr, mapping, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            // No fallback to operator new, deallocate picks munmap from the size alone
+            if (memory == MAP_FAILED) {
+                throw std::bad_alloc{};
+            }
+            auto* const begin   = static_cast<char*>(memory);
+            auto* const aligned = begin + (huge_page_size - reinterpret_cast<std::size_t>(begin) % huge_page_size) % huge_page_size;
+            if (aligned != begin) {
+                munmap(begin, static_cast<std::size_t>(aligned - begin));
+            }
+            const std::size_t tail = mapping - size - static_cast<std::size_t>(aligned - begin);
+            if (tail) {
+                munmap(aligned + size, tail);
+            }
+            madvise(aligned, size, MADV_HUGEPAGE);
+            return reinterpret_cast<T*>(aligned);
+        }
+#endif
+        return static_cast<T*>(::operator new(bytes));
+    }
+
+    void deallocate(T* p, std::size_t n)
+    {
+#ifdef VERLET_HUGE_PAGES
+        const std::size_t bytes = n * sizeof(T);
+        if (bytes >= huge_page_size) {
+            munmap(p, getMappedSize(bytes));
+            return;
+        }
+#else
+        static_cast<void>(n);
+#endif
+        ::operator delete(p);
+    }
+
+    template<typename U>
+    bool operator==(const HugePageAllocator<U>&) const
+    {
+        return true;
+    }
+
+    template<typename U>
+    bool operator!=(const HugePageAllocator<U>&) const
+    {
+        return false;
+    }
+
+private:
+    static std::size_t getMappedSize(std::size_t bytes)
+    {
+        return (bytes + huge_page_size - 1) / huge_page_size * huge_page_size;
+    }
+};
@@ -1,6 +1,9 @@
 #pragma once
+#include <algorithm>
 #include <vector>
 #include <cstdint>
+#include <limits>
+#include <memory>
 
 
 namespace civ
@@ -8,7 +11,7 @@ namespace civ
 
 using ID = uint64_t;
 
-template<typename T>
+template<typename T, typename TIndex = uint64_t, template<typename> class TAllocator = std::allocator>
 struct Ref;
 
 template<typename T>
@@ -61,16 +64,27 @@ struct ObjectSlotConst
 };
 
 
-struct SlotMetadata
+template<typename TIndex>
+struct BasicSlotMetadata
 {
-    ID rid;
-    ID op_id;
+    TIndex rid;
+    TIndex op_id;
 };
 
+using SlotMetadata = BasicSlotMetadata<ID>;
 
-template<typename T>
+
+// TIndex is the type used to store ids and validity counters, the interface always uses ID.
+// A 32 bits index halves the memory used by ids and metadata, values that do not fit
+// (more than 2^32 slots or operations) are detected and reported by hasIndexOverflow().
+// TAllocator is used for all the internal arrays.
+template<typename T, typename TIndex = uint64_t, template<typename> class TAllocator = std::allocator>
 struct Vector : public GenericProvider
 {
+    using Metadata = BasicSlotMetadata<TIndex>;
+
+    static constexpr uint64_t max_index = std::numeric_limits<TIndex>::max();
+
     Vector()
         : data_size(0)
         , op_count(0)
@@ -90,18 +104,26 @@ struct Vector : public GenericProvider
     // Data ADD / REMOVE
     template<typename... Args>
     ID                 emplace_back(Args&&... args);
+    // Creates count default constructed objects, init(id, object) is called for each of them
+    template<typename TCallback>
+    void               emplace_back_n(uint64_t count, TCallback&& init);
+    // Existing objects are not relocated as long as the size stays below the reserved capacity
+    void               reserve(uint64_t capacity);
     ID                 push_back(const T& obj);
     [[nodiscard]]
     ID                 getNextID() const;
     void               erase(ID id);
     template<typename TPredicate>
     void               remove_if(TPredicate&& f);
+    // Removes the objects whose flag is set, flags are indexed by position in data.
+    // References to remaining objects stay valid.
+    void               remove_marked(const std::vector<uint8_t>& marked);
     void               clear();
     // Data access by ID
     T&                 operator[](ID id);
     const T&           operator[](ID id) const;
     // Returns a standalone object allowing access to the underlying data
-    Ref<T>             getRef(ID id);
+    Ref<T, TIndex, TAllocator> getRef(ID id);
     template<typename U>
     PRef<U>            getPRef(ID id);
     // Returns the data at a specific place in the data vector (not an ID)
@@ -115,23 +137,27 @@ struct Vector : public GenericProvider
     ObjectSlot<T>      getSlotAt(uint64_t i);
     ObjectSlotConst<T> getSlotAt(uint64_t i) const;
     // Iterators
-    typename std::vector<T>::iterator       begin();
-    typename std::vector<T>::iterator       end();
-    typename std::vector<T>::const_iterator begin() const;
-    typename std::vector<T>::const_iterator end() const;
+    typename std::vector<T, TAllocator<T>>::iterator       begin();
+    typename std::vector<T, TAllocator<T>>::iterator       end();
+    typename std::vector<T, TAllocator<T>>::const_iterator begin() const;
+    typename std::vector<T, TAllocator<T>>::const_iterator end() const;
     // Number of objects in the provider
     [[nodiscard]]
     uint64_t size() const;
 
     [[nodiscard]]
     ID getValidityID(ID id) const;
+    // True if an id or an operation counter did not fit in TIndex, references may then be wrongly valid
+    [[nodiscard]]
+    bool hasIndexOverflow() const;
 
 public:
-    std::vector<T>            data;
-    std::vector<uint64_t>     ids;
-    std::vector<SlotMetadata> metadata;
-    uint64_t                  data_size;
-    uint64_t                  op_count;
+    std::vector<T, TAllocator<T>>               data;
+    std::vector<TIndex, TAllocator<TIndex>>     ids;
+    std::vector<Metadata, TAllocator<Metadata>> metadata;
+    uint64_t                                    data_size;
+    uint64_t                                    op_count;
+    bool                                        index_overflow = false;
 
     [[nodiscard]]
     bool          isFull() const;
@@ -144,10 +170,12 @@ public:
     Slot          createNewSlot();
     Slot          getFreeSlot();
     Slot          getSlot();
-    SlotMetadata& getMetadataAt(ID id);
+    Metadata&     getMetadataAt(ID id);
     const T&      getAt(ID id) const;
     [[nodiscard]]
     void*         get(civ::ID id) override;
+    // Narrows a value to the index type, flagging values that do not fit
+    TIndex        toIndex(uint64_t value);
 
     template<typename TCallback>
     void foreach(TCallback&& callback);
@@ -155,25 +183,48 @@ public:
     template<class U> friend struct PRef;
 };
 
-template<typename T>
+template<typename T, typename TIndex, template<typename> class TAllocator>
 template<typename ...Args>
-inline uint64_t Vector<T>::emplace_back(Args&& ...args)
+inline uint64_t Vector<T, TIndex, TAllocator>::emplace_back(Args&& ...args)
 {
     const Slot slot = getSlot();
     new(&data[slot.data_id]) T(std::forward<Args>(args)...);
     return slot.id;
 }
 
-template<typename T>
-inline uint64_t Vector<T>::push_back(const T& obj)
+template<typename T, typename TIndex, template<typename> class TAllocator>
+template<typename TCallback>
+inline void Vector<T, TIndex, TAllocator>::emplace_back_n(uint64_t count, TCallback&& init)
+{
+    // Grows all arrays at once instead of letting each one reallocate on its own
+    const uint64_t required = data_size + count;
+    if (required > data.capacity()) {
+        reserve(std::max(required, 2 * data.capacity()));
+    }
+    for (uint64_t i{0}; i < count; ++i) {
+        const ID id = emplace_back();
+        init(id, data[ids[id]]);
+    }
+}
+
+template<typename T, typename TIndex, template<typename> class TAllocator>
+inline void Vector<T, TIndex, TAllocator>::reserve(uint64_t capacity)
+{
+    data.reserve(capacity);
+    ids.reserve(capacity);
+    metadata.reserve(capacity);
+}
+
+template<typename T, typename TIndex, template<typename> class TAllocator>
+inline uint64_t Vector<T, TIndex, TAllocator>::push_back(const T& obj)
 {
     const Slot slot = getSlot();
     data[slot.data_id] = obj;
     return slot.id;
 }
 
-template<typename T>
-inline void Vector<T>::erase(ID id)
+template<typename T, typename TIndex, template<typename> class TAllocator>
+inline void Vector<T, TIndex, TAllocator>::erase(ID id)
 {
     // Retrieve the object position in data
     const uint64_t data_index = ids[id];
@@ -188,189 +239,218 @@ inline void Vector<T>::erase(ID id)
     std::swap(metadata[data_size], metadata[data_index]);
     std::swap(ids[last_id], ids[id]);
     // Invalidate the operation ID
-    metadata[data_size].op_id = ++op_count;
+    metadata[data_size].op_id = toIndex(++op_count);
 }
 
-template<typename T>
-inline T& Vector<T>::operator[](ID id)
+template<typename T, typename TIndex, template<typename> class TAllocator>
+inline T& Vector<T, TIndex, TAllocator>::operator[](ID id)
 {
     return const_cast<T&>(getAt(id));
 }
 
-template<typename T>
-inline const T& Vector<T>::operator[](ID id) const
+template<typename T, typename TIndex, template<typename> class TAllocator>
+inline const T& Vector<T, TIndex, TAllocator>::operator[](ID id) const
 {
     return getAt(id);
 }
 
-template<typename T>
-inline ObjectSlot<T> Vector<T>::getSlotAt(uint64_t i)
+template<typename T, typename TIndex, template<typename> class TAllocator>
+inline ObjectSlot<T> Vector<T, TIndex, TAllocator>::getSlotAt(uint64_t i)
 {
     return ObjectSlot<T>(metadata[i].rid, &data[i]);
 }
 
-template<typename T>
-inline ObjectSlotConst<T> Vector<T>::getSlotAt(uint64_t i) const
+template<typename T, typename TIndex, template<typename> class TAllocator>
+inline ObjectSlotConst<T> Vector<T, TIndex, TAllocator>::getSlotAt(uint64_t i) const
 {
     return ObjectSlotConst<T>(metadata[i].rid, &data[i]);
 }
 
-template<typename T>
-inline Ref<T> Vector<T>::getRef(ID id)
+template<typename T, typename TIndex, template<typename> class TAllocator>
+inline Ref<T, TIndex, TAllocator> Vector<T, TIndex, TAllocator>::getRef(ID id)
 {
-    return Ref<T>(id, this, metadata[ids[id]].op_id);
+    return Ref<T, TIndex, TAllocator>(id, this, metadata[ids[id]].op_id);
 }
 
-template<typename T>
+template<typename T, typename TIndex, template<typename> class TAllocator>
 template<typename U>
-PRef<U> Vector<T>::getPRef(ID id) {
+PRef<U> Vector<T, TIndex, TAllocator>::getPRef(ID id) {
     return PRef<U>{id, this, metadata[ids[id]].op_id};
 }
 
-template<typename T>
-inline T& Vector<T>::getDataAt(uint64_t i)
+template<typename T, typename TIndex, template<typename> class TAllocator>
+inline T& Vector<T, TIndex, TAllocator>::getDataAt(uint64_t i)
 {
     return data[i];
 }
 
-template<typename T>
-inline uint64_t Vector<T>::getID(uint64_t i) const
+template<typename T, typename TIndex, template<typename> class TAllocator>
+inline uint64_t Vector<T, TIndex, TAllocator>::getID(uint64_t i) const
 {
     return metadata[i].rid;
 }
 
-template<typename T>
-inline uint64_t Vector<T>::size() const
+template<typename T, typename TIndex, template<typename> class TAllocator>
+inline uint64_t Vector<T, TIndex, TAllocator>::size() const
 {
     return data_size;
 }
 
-template<typename T>
-inline typename std::vector<T>::iterator Vector<T>::begin()
+template<typename T, typename TIndex, template<typename> class TAllocator>
+inline typename std::vector<T, TAllocator<T>>::iterator Vector<T, TIndex, TAllocator>::begin()
 {
     return data.begin();
 }
 
-template<typename T>
-inline typename std::vector<T>::iterator Vector<T>::end()
+template<typename T, typename TIndex, template<typename> class TAllocator>
+inline typename std::vector<T, TAllocator<T>>::iterator Vector<T, TIndex, TAllocator>::end()
 {
     return data.begin() + data_size;
 }
 
-template<typename T>
-inline typename std::vector<T>::const_iterator Vector<T>::begin() const
+template<typename T, typename TIndex, template<typename> class TAllocator>
+inline typename std::vector<T, TAllocator<T>>::const_iterator Vector<T, TIndex, TAllocator>::begin() const
 {
     return data.begin();
 }
 
-template<typename T>
-inline typename std::vector<T>::const_iterator Vector<T>::end() const
+template<typename T, typename TIndex, template<typename> class TAllocator>
+inline typename std::vector<T, TAllocator<T>>::const_iterator Vector<T, TIndex, TAllocator>::end() const
 {
     return data.begin() + data_size;
 }
 
-template<typename T>
-inline bool Vector<T>::isFull() const
+template<typename T, typename TIndex, template<typename> class TAllocator>
+inline bool Vector<T, TIndex, TAllocator>::isFull() const
 {
     return data_size == data.size();
 }
 
-template<typename T>
-inline Slot Vector<T>::createNewSlot()
+template<typename T, typename TIndex, template<typename> class TAllocator>
+inline Slot Vector<T, TIndex, TAllocator>::createNewSlot()
 {
     data.emplace_back();
-    ids.push_back(data_size);
-    metadata.push_back({data_size, op_count++});
+    ids.push_back(toIndex(data_size));
+    metadata.push_back({toIndex(data_size), toIndex(op_count++)});
     return { data_size, data_size };
 }
 
-template<typename T>
-inline Slot Vector<T>::getFreeSlot()
+template<typename T, typename TIndex, template<typename> class TAllocator>
+inline Slot Vector<T, TIndex, TAllocator>::getFreeSlot()
 {
     const uint64_t reuse_id = metadata[data_size].rid;
-    metadata[data_size].op_id = op_count++;
+    metadata[data_size].op_id = toIndex(op_count++);
     return { reuse_id, data_size };
 }
 
-template<typename T>
-inline Slot Vector<T>::getSlot()
+template<typename T, typename TIndex, template<typename> class TAllocator>
+inline Slot Vector<T, TIndex, TAllocator>::getSlot()
 {
     const Slot slot = isFull() ? createNewSlot() : getFreeSlot();
     ++data_size;
     return slot;
 }
 
-template<typename T>
-inline SlotMetadata& Vector<T>::getMetadataAt(ID id)
+template<typename T, typename TIndex, template<typename> class TAllocator>
+inline typename Vector<T, TIndex, TAllocator>::Metadata& Vector<T, TIndex, TAllocator>::getMetadataAt(ID id)
 {
     return metadata[getDataID(id)];
 }
 
-template<typename T>
-inline uint64_t Vector<T>::getDataID(ID id) const
+template<typename T, typename TIndex, template<typename> class TAllocator>
+inline uint64_t Vector<T, TIndex, TAllocator>::getDataID(ID id) const
 {
     return ids[id];
 }
 
-template<typename T>
-inline const T& Vector<T>::getAt(ID id) const
+template<typename T, typename TIndex, template<typename> class TAllocator>
+inline const T& Vector<T, TIndex, TAllocator>::getAt(ID id) const
 {
     return data[getDataID(id)];
 }
 
-template<typename T>
-inline bool Vector<T>::isValid(ID id, ID validity) const
+template<typename T, typename TIndex, template<typename> class TAllocator>
+inline bool Vector<T, TIndex, TAllocator>::isValid(ID id, ID validity) const
 {
     return validity == metadata[getDataID(id)].op_id;
 }
 
-template<typename T>
-inline uint64_t Vector<T>::getOperationID(ID id) const
+template<typename T, typename TIndex, template<typename> class TAllocator>
+inline uint64_t Vector<T, TIndex, TAllocator>::getOperationID(ID id) const
 {
     return metadata[getDataID(id)].op_id;
 }
 
-template<typename T>
+template<typename T, typename TIndex, template<typename> class TAllocator>
 template<typename TPredicate>
-void Vector<T>::remove_if(TPredicate&& f)
+void Vector<T, TIndex, TAllocator>::remove_if(TPredicate&& f)
+{
+    std::vector<uint8_t> marked(data_size);
+    for (uint64_t data_index{0}; data_index < data_size; ++data_index) {
+        marked[data_index] = f(data[data_index]);
+    }
+    remove_marked(marked);
+}
+
+template<typename T, typename TIndex, template<typename> class TAllocator>
+void Vector<T, TIndex, TAllocator>::remove_marked(const std::vector<uint8_t>& marked)
 {
-    for (uint64_t data_index{ 0 }; data_index < data_size;) {
-        if (f(data[data_index])) {
-            erase(metadata[data_index].rid);
+    // Holes left by removed objects are filled with the last kept objects, like erase does,
+    // but the whole batch is partitioned in a single pass and only moved objects are fixed up
+    uint64_t front = 0;
+    uint64_t back  = data_size;
+    while (true) {
+        while (front < back && !marked[front]) {
+            ++front;
+        }
+        while (front < back && marked[back - 1]) {
+            --back;
         }
-        else {
-            data_index++;
+        if (front >= back) {
+            break;
         }
+        --back;
+        std::swap(data[front], data[back]);
+        std::swap(metadata[front], metadata[back]);
+        ids[metadata[front].rid] = toIndex(front);
+        ids[metadata[back].rid]  = toIndex(back);
+        ++front;
     }
+    for (uint64_t data_index{front}; data_index < data_size; ++data_index) {
+        data[data_index].~T();
+        // Invalidate the operation ID
+        metadata[data_index].op_id = toIndex(++op_count);
+    }
+    data_size = front;
 }
 
-template<typename T>
-ID Vector<T>::getNextID() const {
+template<typename T, typename TIndex, template<typename> class TAllocator>
+ID Vector<T, TIndex, TAllocator>::getNextID() const {
     return isFull() ? data_size : metadata[data_size].rid;
 }
 
-template<typename T>
-void *Vector<T>::get(civ::ID id)
+template<typename T, typename TIndex, template<typename> class TAllocator>
+void *Vector<T, TIndex, TAllocator>::get(civ::ID id)
 {
     return static_cast<void*>(&data[ids[id]]);
 }
 
-template<typename T>
-void Vector<T>::clear()
+template<typename T, typename TIndex, template<typename> class TAllocator>
+void Vector<T, TIndex, TAllocator>::clear()
 {
     ids.clear();
     data.clear();
     metadata.clear();
-    for (SlotMetadata& slm : metadata) {
+    for (Metadata& slm : metadata) {
         slm.rid   = 0;
-        slm.op_id = ++op_count;
+        slm.op_id = toIndex(++op_count);
     }
     data_size = 0;
 }
 
-template<typename T>
+template<typename T, typename TIndex, template<typename> class TAllocator>
 template<typename TCallback>
-void Vector<T>::foreach(TCallback &&callback) {
+void Vector<T, TIndex, TAllocator>::foreach(TCallback &&callback) {
     // Use index based for to allow data creation during iteration
     const uint64_t current_size = data_size;
     for (uint64_t i{0}; i<current_size; i++) {
@@ -378,13 +458,28 @@ void Vector<T>::foreach(TCallback &&callback) {
     }
 }
 
-template<typename T>
-ID Vector<T>::getValidityID(ID id) const
+template<typename T, typename TIndex, template<typename> class TAllocator>
+ID Vector<T, TIndex, TAllocator>::getValidityID(ID id) const
 {
     return metadata[ids[id]].op_id;
 }
 
-template<typename T>
+template<typename T, typename TIndex, template<typename> class TAllocator>
+inline bool Vector<T, TIndex, TAllocator>::hasIndexOverflow() const
+{
+    return index_overflow;
+}
+
+template<typename T, typename TIndex, template<typename> class TAllocator>
+inline TIndex Vector<T, TIndex, TAllocator>::toIndex(uint64_t value)
+{
+    if constexpr (max_index < std::numeric_limits<uint64_t>::max()) {
+        index_overflow |= value > max_index;
+    }
+    return static_cast<TIndex>(value);
+}
+
+template<typename T, typename TIndex, template<typename> class TAllocator>
 struct Ref
 {
     Ref()
@@ -393,7 +488,7 @@ struct Ref
         , validity_id(0)
     {}
 
-    Ref(ID id_, Vector<T>* a, ID vid)
+    Ref(ID id_, Vector<T, TIndex, TAllocator>* a, ID vid)
         : id(id_)
         , array(a)
         , validity_id(vid)
@@ -431,9 +526,9 @@ struct Ref
     }
 
 public:
-    ID         id;
-    Vector<T>* array;
-    ID         validity_id;
+    ID                             id;
+    Vector<T, TIndex, TAllocator>* array;
+    ID                             validity_id;
 };
 
 
@@ -449,8 +544,8 @@ struct PRef
         , validity_id(0)
     {}
 
-    template<typename U>
-    PRef(ID index, Vector<U>* a, ID vid)
+    template<typename U, typename TIndex, template<typename> class TAllocator>
+    PRef(ID index, Vector<U, TIndex, TAllocator>* a, ID vid)
         : id(index)
         , provider_callback{PRef<T>::get<U>}
         , provider(a)
@@ -505,7 +600,7 @@ private:
     uint64_t            validity_id;
 
     template<class U> friend struct PRef;
-    template<class U> friend struct Vector;
+    template<class U, class TIndex, template<typename> class TAllocator> friend struct Vector;
 };
 
 }
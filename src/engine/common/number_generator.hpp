@@ -1,4 +1,7 @@
 #pragma once
+#include <array>
+#include <atomic>
+#include <cstdint>
 #include <random>
 
 
@@ -9,8 +12,15 @@ protected:
 	std::mt19937 gen;
 
 	NumberGenerator()
-		: gen(1)
+		: gen(getSeed())
 	{}
+
+	// Generators are per thread, the first one keeps the historical seed
+	static std::mt19937::result_type getSeed()
+	{
+		static std::atomic<std::mt19937::result_type> next_seed{1};
+		return next_seed++;
+	}
 };
 
 
@@ -54,11 +64,12 @@ public:
 };
 
 
+// Each thread has its own generator, see CounterRNG for reproducible parallel draws
 template<typename T>
 class RNG
 {
 private:
-	static RealNumberGenerator<T> gen;
+	static thread_local RealNumberGenerator<T> gen;
 
 public:
 	static T get()
@@ -100,7 +111,7 @@ public:
 using RNGf = RNG<float>;
 
 template<typename T>
-RealNumberGenerator<T> RNG<T>::gen = RealNumberGenerator<T>();
+thread_local RealNumberGenerator<T> RNG<T>::gen = RealNumberGenerator<T>();
 
 
 template<typename T>
@@ -134,7 +145,7 @@ template<typename T>
 class RNGi
 {
 private:
-	static IntegerNumberGenerator<T> gen;
+	static thread_local IntegerNumberGenerator<T> gen;
 
 public:
 	static T getUnder(T max)
@@ -149,9 +160,84 @@ public:
 };
 
 template<typename T>
-IntegerNumberGenerator<T> RNGi<T>::gen;
+thread_local IntegerNumberGenerator<T> RNGi<T>::gen;
 
 using RNGi32 = RNGi<int32_t>;
 using RNGi64 = RNGi<int64_t>;
 using RNGu32 = RNGi<uint32_t>;
 using RNGu64 = RNGi<uint64_t>;
+
+
+// Counter based generator (Philox4x32-10). A draw is a pure function of the seed, the stream,
+// the index (typically a particle's) and the draw number, so it can be evaluated from any
+// thread in any order and gives the same result whatever the work split.
+class CounterRNG
+{
+public:
+	using Block = std::array<uint32_t, 4>;
+
+	explicit
+	CounterRNG(uint64_t seed = 0, uint32_t stream = 0)
+		: key{static_cast<uint32_t>(seed), static_cast<uint32_t>(seed >> 32)}
+		, stream{stream}
+	{}
+
+	// Four independent 32 bits values, draws 4 * block to 4 * block + 3 of index
+	[[nodiscard]]
+	Block getBlock(uint64_t index, uint32_t block = 0) const
+	{
+		return philox({static_cast<uint32_t>(index), static_cast<uint32_t>(index >> 32), block, stream}, key);
+	}
+
+	// Uniform in [0, 1)
+	[[nodiscard]]
+	float get(uint64_t index, uint32_t draw = 0) const
+	{
+		return toFloat(getBlock(index, draw / 4)[draw % 4]);
+	}
+
+	[[nodiscard]]
+	float getRange(float min, float max, uint64_t index, uint32_t draw = 0) const
+	{
+		return min + get(index, draw) * (max - min);
+	}
+
+	// out[i] = get(first_index + i, draw), the loop has no dependency between iterations
+	void fill(float* out, uint32_t count, uint64_t first_index = 0, uint32_t draw = 0) const
+	{
+		for (uint32_t i{0}; i < count; ++i) {
+			out[i] = toFloat(getBlock(first_index + i, draw / 4)[draw % 4]);
+		}
+	}
+
+	void fillRange(float* out, uint32_t count, float min, float max, uint64_t first_index = 0, uint32_t draw = 0) const
+	{
+		fill(out, count, first_index, draw);
+		for (uint32_t i{0}; i < count; ++i) {
+			out[i] = min + out[i] * (max - min);
+		}
+	}
+
+	// 24 high bits to the float mantissa
+	static float toFloat(uint32_t x)
+	{
+		return static_cast<float>(x >> 8) * (1.0f / 16777216.0f);
+	}
+
+	static Block philox(Block counter, std::array<uint32_t, 2> k)
+	{
+		for (uint32_t round{0}; round < 10; ++round) {
+			const uint64_t p0 = static_cast<uint64_t>(0xD2511F53u) * counter[0];
+			const uint64_t p1 = static_cast<uint64_t>(0xCD9E8D57u) * counter[2];
+			counter = {static_cast<uint32_t>(p1 >> 32) ^ counter[1] ^ k[0], static_cast<uint32_t>(p1),
+			           static_cast<uint32_t>(p0 >> 32) ^ counter[3] ^ k[1], static_cast<uint32_t>(p0)};
+			k[0] += 0x9E3779B9u;
+			k[1] += 0xBB67AE85u;
+		}
+		return counter;
+	}
+
+private:
+	std::array<uint32_t, 2> key;
+	uint32_t                stream;
+};
@@ -1,4 +1,7 @@
 #pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
 #include <vector>
 
 
@@ -89,3 +92,99 @@ struct RDiff : public RAccBase<T>
         return RAccBase<T>::values[RAccBase<T>::getIndex(-1)] - RAccBase<T>::values[RAccBase<T>::getIndex()];
     }
 };
+
+
+// Streaming quantile estimator over log-linear buckets (HDR histogram style). Each power of two
+// is split in sub_buckets_count linear buckets, so estimates are within 1 / sub_buckets_count of
+// the true value whatever the number of samples. Estimators with the same layout can be merged.
+template<typename T>
+struct RQuantile
+{
+    static constexpr int32_t  min_exponent      = -24;
+    static constexpr int32_t  max_exponent      = 24;
+    static constexpr uint32_t sub_buckets_count = 64;
+    static constexpr uint32_t buckets_count     = (max_exponent - min_exponent) * sub_buckets_count;
+
+    std::vector<uint64_t> counts;
+    uint64_t              total     = 0;
+    T                     max_value = 0;
+
+    RQuantile()
+        : counts(buckets_count, 0)
+    {
+    }
+
+    // Values under 2^min_exponent fall in the first bucket, values over 2^max_exponent in the last one
+    void addValue(T v)
+    {
+        ++counts[getBucket(v)];
+        ++total;
+        max_value = std::max(max_value, v);
+    }
+
+    void merge(const RQuantile<T>& other)
+    {
+        for (uint32_t i{0}; i < buckets_count; ++i) {
+            counts[i] += other.counts[i];
+        }
+        total    += other.total;
+        max_value = std::max(max_value, other.max_value);
+    }
+
+    void reset()
+    {
+        std::fill(counts.begin(), counts.end(), 0);
+        total     = 0;
+        max_value = 0;
+    }
+
+    // Value under which lies the given fraction of the samples, 0.99 for the 99th percentile
+    T get(double quantile) const
+    {
+        if (!total) {
+            return 0;
+        }
+        const auto rank = static_cast<uint64_t>(std::ceil(quantile * static_cast<double>(total)));
+        uint64_t   seen = 0;
+        for (uint32_t i{0}; i < buckets_count; ++i) {
+            seen += counts[i];
+            if (seen >= std::max<uint64_t>(rank, 1)) {
+                return std::min(getBucketValue(i), max_value);
+            }
+        }
+        return max_value;
+    }
+
+    uint64_t getCount() const
+    {
+        return total;
+    }
+
+private:
+    static uint32_t getBucket(T v)
+    {
+        if (!(v > 0)) {
+            return 0;
+        }
+        int32_t exponent = 0;
+        // Mantissa in [0.5, 1)
+        const double mantissa = std::frexp(static_cast<double>(v), &exponent);
+        if (exponent <= min_exponent) {
+            return 0;
+        }
+        if (exponent > max_exponent) {
+            return buckets_count - 1;
+        }
+        const auto sub = static_cast<uint32_t>((mantissa - 0.5) * 2.0 * sub_buckets_count);
+        return static_cast<uint32_t>(exponent - min_exponent - 1) * sub_buckets_count + std::min(sub, sub_buckets_count - 1);
+    }
+
+    // Middle of the bucket
+    static T getBucketValue(uint32_t bucket)
+    {
+        const int32_t  exponent = static_cast<int32_t>(bucket / sub_buckets_count) + min_exponent + 1;
+        const uint32_t sub      = bucket % sub_buckets_count;
+        const double   mantissa = 0.5 + (static_cast<double>(sub) + 0.5) / (2.0 * sub_buckets_count);
+        return static_cast<T>(std::ldexp(mantissa, exponent));
+    }
+};
@@ -0,0 +1,144 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+
+// Order 0 byte oriented rANS entropy coder.
+// Output layout: 256 normalized frequencies (uint16), then the final coder state and the stream.
+struct RansCoder
+{
+    static constexpr uint32_t scale_bits  = 12;
+    static constexpr uint32_t scale       = 1u << scale_bits;
+    static constexpr uint32_t lower_bound = 1u << 23;
+    static constexpr uint32_t table_size  = 256 * sizeof(uint16_t);
+
+    static void encode(const uint8_t* input, uint32_t size, std::vector<uint8_t>& output)
+    {
+        std::array<uint32_t, 256> frequencies = computeFrequencies(input, size);
+        std::array<uint32_t, 257> cumulated   = computeCumulated(frequencies);
+
+        const auto output_start = static_cast<uint32_t>(output.size());
+        output.resize(output_start + table_size);
+        for (uint32_t s{0}; s < 256; ++s) {
+            const auto frequency = static_cast<uint16_t>(frequencies[s]);
+            std::memcpy(output.data() + output_start + 2 * s, &frequency, sizeof(uint16_t));
+        }
+        // Symbols are encoded backward so the decoder can read forward
+        std::vector<uint8_t> stream;
+        stream.reserve(size + 4);
+        uint32_t state = lower_bound;
+        for (uint32_t i{size}; i--;) {
+            const uint8_t  symbol    = input[i];
+            const uint32_t frequency = frequencies[symbol];
+            const uint32_t state_max = ((lower_bound >> scale_bits) << 8) * frequency;
+            while (state >= state_max) {
+                stream.push_back(static_cast<uint8_t>(state & 0xFF));
+                state >>= 8;
+            }
+            state = ((state / frequency) << scale_bits) + (state % frequency) + cumulated[symbol];
+        }
+        for (uint32_t i{0}; i < 4; ++i) {
+            stream.push_back(static_cast<uint8_t>(state >> (i * 8)));
+        }
+        output.insert(output.end(), stream.rbegin(), stream.rend());
+    }
+
+    // Returns false if the input is malformed
+    static bool decode(const uint8_t* input, uint32_t input_size, uint8_t* output, uint32_t output_size)
+    {
+        if (output_size == 0) {
+            return true;
+        }
+        if (input_size < table_size + 4) {
+            return false;
+        }
+        std::array<uint32_t, 256> frequencies{};
+        for (uint32_t s{0}; s < 256; ++s) {
+            uint16_t frequency;
+            std::memcpy(&frequency, input + 2 * s, sizeof(uint16_t));
+            frequencies[s] = frequency;
+        }
+        const std::array<uint32_t, 257> cumulated = computeCumulated(frequencies);
+        if (cumulated[256] != scale) {
+            return false;
+        }
+        std::array<uint8_t, scale> slot_to_symbol{};
+        for (uint32_t s{0}; s < 256; ++s) {
+            for (uint32_t slot{cumulated[s]}; slot < cumulated[s + 1]; ++slot) {
+                slot_to_symbol[slot] = static_cast<uint8_t>(s);
+            }
+        }
+
+        const uint8_t* current = input + table_size;
+        const uint8_t* end     = input + input_size;
+        uint32_t state = 0;
+        for (uint32_t i{0}; i < 4; ++i) {
+            state = (state << 8) | *current++;
+        }
+        for (uint32_t i{0}; i < output_size; ++i) {
+            const uint32_t slot   = state & (scale - 1);
+            const uint8_t  symbol = slot_to_symbol[slot];
+            output[i] = symbol;
+            state = frequencies[symbol] * (state >> scale_bits) + slot - cumulated[symbol];
+            while (state < lower_bound) {
+                if (current == end) {
+                    return false;
+                }
+                state = (state << 8) | *current++;
+            }
+        }
+        return true;
+    }
+
+private:
+    // Frequencies normalized to sum to scale, every present symbol keeps a non zero frequency
+    static std::array<uint32_t, 256> computeFrequencies(const uint8_t* input, uint32_t size)
+    {
+        std::array<uint32_t, 256> counts{};
+        for (uint32_t i{0}; i < size; ++i) {
+            ++counts[input[i]];
+        }
+        std::array<uint32_t, 256> frequencies{};
+        if (size == 0) {
+            frequencies[0] = scale;
+            return frequencies;
+        }
+        uint32_t sum     = 0;
+        uint32_t largest = 0;
+        for (uint32_t s{0}; s < 256; ++s) {
+            if (counts[s]) {
+                frequencies[s] = std::max(1u, static_cast<uint32_t>((static_cast<uint64_t>(counts[s]) * scale) / size));
+                sum += frequencies[s];
+                largest = frequencies[s] > frequencies[largest] ? s : largest;
+            }
+        }
+        // Rounding errors are absorbed by the most frequent symbol
+        if (sum < scale) {
+            frequencies[largest] += scale - sum;
+        } else {
+            uint32_t excess = sum - scale;
+            while (excess) {
+                for (uint32_t s{0}; s < 256 && excess; ++s) {
+                    if (frequencies[s] > 1) {
+                        const uint32_t removed = std::min(excess, frequencies[s] / 2);
+                        frequencies[s] -= removed;
+                        excess -= removed;
+                    }
+                }
+            }
+        }
+        return frequencies;
+    }
+
+    static std::array<uint32_t, 257> computeCumulated(const std::array<uint32_t, 256>& frequencies)
+    {
+        std::array<uint32_t, 257> cumulated{};
+        for (uint32_t s{0}; s < 256; ++s) {
+            cumulated[s + 1] = cumulated[s] + frequencies[s];
+        }
+        return cumulated;
+    }
+};
@@ -0,0 +1,48 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+
+
+// Lock free single producer / single consumer hand-off.
+// The producer fills the write buffer and publishes it, the consumer acquires the
+// most recent published buffer. Both sides only swap indices, data is never copied.
+template<typename T>
+struct TripleBuffer
+{
+    static constexpr uint8_t index_mask = 0b011;
+    static constexpr uint8_t new_flag   = 0b100;
+
+    T                    buffers[3];
+    // Index of the buffer shared between both sides, plus a flag telling if it holds new data
+    std::atomic<uint8_t> shared_state = 1;
+    uint8_t              write_index  = 0;
+    uint8_t              read_index   = 2;
+
+    // Producer side
+    T& getWriteBuffer()
+    {
+        return buffers[write_index];
+    }
+
+    void publish()
+    {
+        const uint8_t previous = shared_state.exchange(write_index | new_flag, std::memory_order_acq_rel);
+        write_index = previous & index_mask;
+    }
+
+    // Consumer side, returns true if a new buffer was acquired
+    bool acquire()
+    {
+        if (!(shared_state.load(std::memory_order_relaxed) & new_flag)) {
+            return false;
+        }
+        const uint8_t previous = shared_state.exchange(read_index, std::memory_order_acq_rel);
+        read_index = previous & index_mask;
+        return true;
+    }
+
+    const T& getReadBuffer() const
+    {
+        return buffers[read_index];
+    }
+};
@@ -10,8 +10,8 @@ U to(const T& v)
 }
 
 
-template<typename T>
-using CIVector = civ::Vector<T>;
+template<typename T, typename TIndex = uint64_t, template<typename> class TAllocator = std::allocator>
+using CIVector = civ::Vector<T, TIndex, TAllocator>;
 
 
 template<typename T>
@@ -130,6 +130,11 @@ public:
     {
         m_window.setFramerateLimit(framerate);
     }
+
+    void setTitle(const std::string& title)
+    {
+        m_window.setTitle(title);
+    }
     
 private:
     sf::RenderWindow m_window;
@@ -3,58 +3,287 @@
 #include "engine/window_context_handler.hpp"
 #include "engine/common/color_utils.hpp"
 
+#include "app_options.hpp"
+#include "broadcast/state_broadcaster.hpp"
+#include "metrics/metrics_server.hpp"
 #include "physics/physics.hpp"
+#include "physics/state_file.hpp"
+#include "profiler/auto_tuner.hpp"
+#include "profiler/scaling_report.hpp"
+#include "recording/trajectory_player.hpp"
+#include "recording/trajectory_recorder.hpp"
+#include "shared_memory/particle_export.hpp"
+#include "simulation/frame_budget.hpp"
+#include "simulation/frame_capture.hpp"
+#include "simulation/simulation_thread.hpp"
 #include "thread_pool/thread_pool.hpp"
+#include "thread_pool/trace_capture.hpp"
 #include "renderer/renderer.hpp"
 
 
-int main()
+// Plays a recorded trajectory, the solver is only used to give the world's dimensions to the renderer
+int32_t replay(const std::string& path, WindowContextHandler& app, tp::ThreadPool& thread_pool, uint32_t window_height)
 {
+    TrajectoryPlayer player{thread_pool};
+    if (!player.open(path)) {
+        return 1;
+    }
+    const auto& header = player.getFileHeader();
+    const IVec2 world_size{to<int32_t>(header.world_width), to<int32_t>(header.world_height)};
+    PhysicSolver solver{world_size, thread_pool};
+    Renderer renderer(solver, thread_pool);
+
+    RenderContext& render_context = app.getRenderContext();
+    const float margin = 20.0f;
+    render_context.setZoom(static_cast<float>(window_height - margin) / static_cast<float>(world_size.y));
+    render_context.setFocus({world_size.x * 0.5f, world_size.y * 0.5f});
+
+    ParticleFrame frame;
+    bool paused = false;
+    const auto seek = [&](int64_t target) {
+        const auto last  = static_cast<int64_t>(player.getFramesCount()) - 1;
+        const auto start = std::chrono::steady_clock::now();
+        if (player.seek(static_cast<uint32_t>(std::min(std::max(target, int64_t{0}), last)), frame)) {
+            const std::chrono::duration<float, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+            std::cout << "Frame " << player.getNextFrame() - 1 << " reached in " << elapsed.count() << " ms" << std::endl;
+        }
+    };
+    // Seek steps are one keyframe interval
+    const auto seek_step = static_cast<int64_t>(header.keyframe_interval);
+    app.getEventManager().addKeyPressedCallback(sf::Keyboard::Space, [&](sfev::CstEv) {
+        paused = !paused;
+    });
+    app.getEventManager().addKeyPressedCallback(sf::Keyboard::Right, [&](sfev::CstEv) {
+        seek(static_cast<int64_t>(player.getNextFrame()) - 1 + seek_step);
+    });
+    app.getEventManager().addKeyPressedCallback(sf::Keyboard::Left, [&](sfev::CstEv) {
+        seek(static_cast<int64_t>(player.getNextFrame()) - 1 - seek_step);
+    });
+    app.getEventManager().addKeyPressedCallback(sf::Keyboard::Home, [&](sfev::CstEv) {
+        seek(0);
+    });
+    int32_t target_fps = 60;
+    app.getEventManager().addKeyPressedCallback(sf::Keyboard::S, [&](sfev::CstEv) {
+        target_fps = target_fps ? 0 : 60;
+        app.setFramerateLimit(target_fps);
+    });
+
+    while (app.run()) {
+        // Playback loops at the end of the file
+        if (!paused && !player.next(frame)) {
+            seek(0);
+        }
+        render_context.clear();
+        renderer.render(render_context, frame);
+        render_context.display();
+    }
+    return 0;
+}
+
+
+int main(int argc, char** argv)
+{
+    const AppOptions options = AppOptions::parse(argc, argv);
+    if (!options.valid) {
+        return 1;
+    }
+    if (options.scaling_report) {
+        ScalingReport report;
+        report.json_path = options.scaling_json_path;
+        return report.run();
+    }
+#ifdef VERLET_PROFILING
+    profiler::Profiler::get().setHardwareCounters(options.perf_counters);
+#endif
+    const TuningConfig tuning = options.auto_tune ? AutoTuner{}.getConfig(options.tuning_cache_path, options.retune) : TuningConfig{};
+
     const uint32_t window_width  = 1920;
     const uint32_t window_height = 1080;
     WindowContextHandler app("Verlet-MultiThread", sf::Vector2u(window_width, window_height), sf::Style::Default);
     RenderContext& render_context = app.getRenderContext();
     // Initialize solver and renderer
 
-    tp::ThreadPool thread_pool(10);
+    tp::ThreadPool thread_pool(tuning.threads_count);
+    // Before any solver memory is placed
+    if (options.affinity != tp::Affinity::None && !thread_pool.setAffinity(options.affinity)) {
+        std::cout << "Workers could not be pinned" << std::endl;
+    }
+    if (!options.replay_path.empty()) {
+        return replay(options.replay_path, app, thread_pool, window_height);
+    }
     const IVec2 world_size{300, 300};
+    // Close to the world's capacity, the frame budget usually stops emission earlier
+    constexpr uint32_t max_objects_count = 80000;
     PhysicSolver solver{world_size, thread_pool};
+    tuning.apply(solver);
+    // Objects are never relocated while emitting
+    solver.objects.reserve(max_objects_count);
+    if (!options.load_path.empty() && StateFile::load(solver, options.load_path)) {
+        std::cout << "Loaded " << solver.objects.size() << " objects from " << options.load_path << std::endl;
+    }
     Renderer renderer(solver, thread_pool);
 
+    // Objects are copied once per update for all the consumers of frames
+    FrameCapture frame_capture{solver, thread_pool};
+    TrajectoryRecorder recorder;
+    if (!options.record_path.empty() && recorder.start(options.record_path, solver.world_size)) {
+        recorder.attach(frame_capture);
+    }
+    // Only one endpoint is served, the Unix socket is preferred when both are given
+    StateBroadcaster broadcaster;
+    if ((!options.broadcast_path.empty() && broadcaster.listenUnix(options.broadcast_path)) ||
+        (options.broadcast_path.empty() && options.broadcast_port && broadcaster.listenTcp(options.broadcast_port))) {
+        broadcaster.attach(frame_capture, solver.world_size);
+    }
+    ParticleExport particle_export{thread_pool, max_objects_count};
+    if (!options.export_name.empty() && particle_export.create(options.export_name, solver.world_size)) {
+        particle_export.attach(frame_capture);
+    }
+    MetricsServer metrics{thread_pool};
+    if ((!options.metrics_path.empty() && metrics.listenUnix(options.metrics_path)) ||
+        (options.metrics_path.empty() && options.metrics_port && metrics.listenTcp(options.metrics_port))) {
+        metrics.attach(solver);
+    }
+
+    constexpr uint32_t fps_cap = 60;
+    // In fixed step mode the simulation rate is independent from the frame rate
+    const float dt = 1.0f / (options.fixed_step ? options.sim_rate : static_cast<float>(fps_cap));
+    const auto  pacing = options.fixed_step ? SimulationThread::Pacing::FixedStep : SimulationThread::Pacing::Lockstep;
+    SimulationThread simulation{solver, frame_capture, dt, pacing};
+    // When the simulation is threaded the solver belongs to its thread, modifications are queued
+    const auto edit_solver = [&](const SimulationThread::SolverCallback& callback) {
+        if (options.threadedSimulation()) {
+            simulation.post(callback);
+        } else {
+            callback(solver);
+        }
+    };
+
     const float margin = 20.0f;
     const auto  zoom   = static_cast<float>(window_height - margin) / static_cast<float>(world_size.y);
     render_context.setZoom(zoom);
     render_context.setFocus({world_size.x * 0.5f, world_size.y * 0.5f});
 
-    bool emit = true;
+    // Same stream as before: a vertical line of 20 objects per update thrown to the right
+    Emitter emitter;
+    emitter.shape    = Emitter::Shape::Line;
+    emitter.position = {2.0f, 10.0f + 1.1f * 19.0f};
+    emitter.size     = {0.0f, -1.1f * 19.0f};
+    emitter.rate     = 20.0f / dt;
+    emitter.velocity = {96.0f, 0.0f};
+    emitter.color    = [](civ::ID id) {
+        return ColorUtils::getRainbow(id * 0.0001f);
+    };
+    emitter.max_objects_count = max_objects_count;
+    solver.emitters.push_back(emitter);
+
+    const float frame_budget_ms = options.frame_budget_ms > 0.0f ? options.frame_budget_ms : 1000.0f / static_cast<float>(fps_cap);
+    FrameBudget frame_budget{max_objects_count, frame_budget_ms, dt * 1000.0f, options.threadedSimulation()};
+    frame_budget.enabled = options.frame_budget;
+
     app.getEventManager().addKeyPressedCallback(sf::Keyboard::Space, [&](sfev::CstEv) {
-        emit = !emit;
+        edit_solver([](PhysicSolver& s) {
+            s.emitters[0].enabled = !s.emitters[0].enabled;
+        });
     });
 
-    constexpr uint32_t fps_cap = 60;
     int32_t target_fps = fps_cap;
     app.getEventManager().addKeyPressedCallback(sf::Keyboard::S, [&](sfev::CstEv) {
         target_fps = target_fps ? 0 : fps_cap;
         app.setFramerateLimit(target_fps);
     });
 
-    // Main loop
-    const float dt = 1.0f / static_cast<float>(fps_cap);
-    while (app.run()) {
-        if (solver.objects.size() < 80000 && emit) {
-            for (uint32_t i{20}; i--;) {
-                const auto id = solver.createObject({2.0f, 10.0f + 1.1f * i});
-                solver.objects[id].last_position.x -= 0.2f;
-                solver.objects[id].color = ColorUtils::getRainbow(id * 0.0001f);
+    app.getEventManager().addKeyPressedCallback(sf::Keyboard::A, [&](sfev::CstEv) {
+        edit_solver([](PhysicSolver& s) {
+            s.adaptive.enabled = !s.adaptive.enabled;
+            std::cout << "Adaptive sub steps " << (s.adaptive.enabled ? "enabled" : "disabled") << std::endl;
+        });
+    });
+
+    app.getEventManager().addKeyPressedCallback(sf::Keyboard::M, [&](sfev::CstEv) {
+        edit_solver([](PhysicSolver& s) {
+            const char* names[] = {"barrier", "temporal blocking", "task graph"};
+            const auto  next    = (static_cast<uint32_t>(s.mode) + 1) % 3;
+            s.mode = static_cast<UpdateMode>(next);
+            std::cout << "Update mode: " << names[next] << std::endl;
+        });
+    });
+
+    tp::TraceCapture trace{thread_pool};
+    app.getEventManager().addKeyPressedCallback(sf::Keyboard::T, [&](sfev::CstEv) {
+        trace.start(options.trace_path, options.trace_frames);
+    });
+
+#ifdef VERLET_PROFILING
+    app.getEventManager().addKeyPressedCallback(sf::Keyboard::P, [&](sfev::CstEv) {
+        profiler::Profiler::get().print(std::cout);
+    });
+#endif
+
+    app.getEventManager().addKeyPressedCallback(sf::Keyboard::F5, [&](sfev::CstEv) {
+        edit_solver([&](PhysicSolver& s) {
+            if (StateFile::save(s, options.save_path)) {
+                std::cout << "Saved " << s.objects.size() << " objects to " << options.save_path << std::endl;
             }
-        }
+        });
+    });
 
-        solver.update(dt);
+    if (options.threadedSimulation()) {
+        simulation.start();
+    }
 
+    // Main loop
+    uint32_t frame_count = 0;
+    while (app.run()) {
         render_context.clear();
-        renderer.render(render_context);
+        SolverHealth health;
+        uint64_t     objects_count;
+        float        solve_ms;
+        std::chrono::steady_clock::time_point render_start;
+        if (options.threadedSimulation()) {
+            const SimulationThread::PresentedFrame& presented = simulation.acquireFrame();
+            const ParticleFrame& frame = *presented.frame;
+            render_start = std::chrono::steady_clock::now();
+            renderer.render(render_context, frame, presented.previous.get(), simulation.getInterpolationRatio(presented));
+            health        = frame.health;
+            objects_count = frame.size();
+            solve_ms      = frame.update_ms;
+        } else {
+            solver.update(dt);
+            render_start = std::chrono::steady_clock::now();
+            renderer.render(render_context);
+            health        = solver.health;
+            objects_count = solver.objects.size();
+            solve_ms      = solver.last_update_ms;
+        }
+        // Display is left out, it waits for the frame rate cap
+        const std::chrono::duration<float, std::milli> render_time = std::chrono::steady_clock::now() - render_start;
+        if (frame_budget.update(solve_ms, render_time.count(), to<uint32_t>(objects_count))) {
+            const uint32_t cap = frame_budget.cap;
+            edit_solver([cap](PhysicSolver& s) {
+                s.emitters[0].max_objects_count = cap;
+            });
+        }
+        // The solver's workload is shown in the title, the HUD has no text
+        if (++frame_count % 30 == 0) {
+            app.setTitle("Verlet-MultiThread | " + toString(objects_count) + " objects | " +
+                         toString(health.candidates_tested) + " pairs tested, " + toString(health.contacts_resolved) + " resolved | " +
+                         "max penetration " + toString(health.max_penetration) + " | " +
+                         toString(health.cell_overflows) + " cell overflows, " + toString(health.border_skips) + " border skips");
+        }
         render_context.display();
+        trace.onFrame();
+    }
+    simulation.stop();
+    if (frame_budget.capacity) {
+        std::cout << "Capacity within the " << frame_budget_ms << " ms frame budget: " << frame_budget.capacity << " objects" << std::endl;
     }
+    recorder.stop();
+    broadcaster.stop();
+    metrics.stop();
+#ifdef VERLET_PROFILING
+    profiler::Profiler::get().print(std::cout);
+#endif
 
     return 0;
 }
@@ -0,0 +1,368 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include "physics/physics.hpp"
+#include "profiler/profiler.hpp"
+#include "engine/common/racc.hpp"
+#include "engine/common/triple_buffer.hpp"
+
+#if defined(__unix__) || defined(__APPLE__)
+    #include <arpa/inet.h>
+    #include <fcntl.h>
+    #include <netinet/in.h>
+    #include <poll.h>
+    #include <sys/socket.h>
+    #include <sys/un.h>
+    #include <unistd.h>
+    #define VERLET_METRICS_SOCKETS 1
+#endif
+
+
+// Serves the solver's metrics in the Prometheus text format over HTTP, on a localhost TCP
+// port or a Unix socket (curl --unix-socket). After each update the solver thread fills a
+// snapshot handed over through a triple buffer, scrapes read the latest one on the server
+// thread so they never wait for or block the update. Quantiles are computed when publishing,
+// a scrape only formats values.
+class MetricsServer
+{
+public:
+    static constexpr std::array<double, 4> update_quantiles = {0.5, 0.9, 0.99, 0.999};
+    static constexpr std::array<double, 3> phase_quantiles  = {0.5, 0.99, 0.999};
+    // Update durations quantiles cover the last update_window to 2 * update_window updates
+    static constexpr uint64_t update_window = 600;
+
+    struct Snapshot
+    {
+        uint64_t     updates_count      = 0;
+        uint64_t     objects_count      = 0;
+        uint32_t     sub_steps          = 0;
+        double       update_seconds_sum = 0.0;
+        std::array<float, update_quantiles.size()> update_ms{};
+#ifdef VERLET_PROFILING
+        std::array<std::array<float, phase_quantiles.size()>, profiler::phases_count> phase_ms{};
+#endif
+        // Last update, and totals since the server was attached
+        SolverHealth health;
+        SolverHealth health_total;
+    };
+
+    explicit
+    MetricsServer(tp::ThreadPool& thread_pool)
+        : m_thread_pool{thread_pool}
+    {}
+
+    ~MetricsServer()
+    {
+        stop();
+    }
+
+    bool listenUnix(const std::string& path)
+    {
+#ifdef VERLET_METRICS_SOCKETS
+        sockaddr_un address{};
+        if (path.size() >= sizeof(address.sun_path)) {
+            std::cerr << "Metrics socket path " << path << " is too long" << std::endl;
+            return false;
+        }
+        address.sun_family = AF_UNIX;
+        std::copy(path.begin(), path.end(), address.sun_path);
+        unlink(path.c_str());
+        m_socket_path = path;
+        return listenOn(socket(AF_UNIX, SOCK_STREAM, 0), reinterpret_cast<const sockaddr*>(&address), sizeof(address));
+#else
+        std::cerr << "Metrics server is not supported on this platform (" << path << ")" << std::endl;
+        return false;
+#endif
+    }
+
+    bool listenTcp(uint16_t port)
+    {
+#ifdef VERLET_METRICS_SOCKETS
+        sockaddr_in address{};
+        address.sin_family      = AF_INET;
+        address.sin_port        = htons(port);
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        const int32_t fd = socket(AF_INET, SOCK_STREAM, 0);
+        const int32_t reuse = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+        return listenOn(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address));
+#else
+        std::cerr << "Metrics server is not supported on this platform (port " << port << ")" << std::endl;
+        return false;
+#endif
+    }
+
+    // Registers the snapshot at the end of the solver's update and starts serving
+    void attach(PhysicSolver& solver)
+    {
+        m_thread_pool.setBusyAccounting(true);
+        solver.update_callbacks.emplace_back([this](const PhysicSolver& s) {
+            publish(s);
+        });
+        m_running = true;
+        m_thread  = std::thread([this]{
+            run();
+        });
+    }
+
+    // Called by the thread running the solver
+    void publish(const PhysicSolver& solver)
+    {
+        Snapshot& current = m_current;
+        ++current.updates_count;
+        current.objects_count       = solver.objects.size();
+        current.sub_steps           = solver.sub_steps;
+        current.update_seconds_sum += solver.last_update_ms * 1e-3;
+        // Both windows receive each value and are reset in turn, the other one is read
+        m_update_windows[0].addValue(solver.last_update_ms);
+        m_update_windows[1].addValue(solver.last_update_ms);
+        const uint64_t window_index = current.updates_count / update_window;
+        if (current.updates_count % update_window == 0) {
+            m_update_windows[window_index % 2].reset();
+        }
+        const RQuantile<float>& update_ms = m_update_windows[(window_index + 1) % 2];
+        for (uint32_t q{0}; q < update_quantiles.size(); ++q) {
+            current.update_ms[q] = update_ms.get(update_quantiles[q]);
+        }
+#ifdef VERLET_PROFILING
+        // Fed by the profiler's collection, done once per frame by the HUD
+        profiler::Profiler& profiler = profiler::Profiler::get();
+        const uint64_t collections_count = profiler.getCollectionsCount();
+        if (collections_count != m_collections_count) {
+            m_collections_count = collections_count;
+            profiler.getQuantiles(phase_quantiles, current.phase_ms);
+        }
+#endif
+        current.health = solver.health;
+        SolverHealth& total = current.health_total;
+        total.candidates_tested += solver.health.candidates_tested;
+        total.contacts_resolved += solver.health.contacts_resolved;
+        total.cell_overflows    += solver.health.cell_overflows;
+        total.border_skips      += solver.health.border_skips;
+        total.max_penetration    = std::max(total.max_penetration, solver.health.max_penetration);
+        m_snapshots.getWriteBuffer() = current;
+        m_snapshots.publish();
+    }
+
+    void stop()
+    {
+        if (!m_thread.joinable()) {
+            return;
+        }
+        m_running = false;
+        m_thread.join();
+#ifdef VERLET_METRICS_SOCKETS
+        for (const Connection& connection : m_connections) {
+            close(connection.fd);
+        }
+        close(m_listen_fd);
+        if (!m_socket_path.empty()) {
+            unlink(m_socket_path.c_str());
+        }
+#endif
+        std::cout << "Metrics server answered " << m_scrapes_count << " scrapes" << std::endl;
+    }
+
+    // Text exposition of the latest snapshot, called on the server thread
+    std::string render()
+    {
+        m_snapshots.acquire();
+        const Snapshot& snapshot = m_snapshots.getReadBuffer();
+        std::ostringstream out;
+        const auto metric = [&out](const char* name, const char* type, const char* help) {
+            out << "# HELP " << name << " " << help << "\n# TYPE " << name << " " << type << "\n";
+        };
+        metric("verlet_objects", "gauge", "Objects in the solver");
+        out << "verlet_objects " << snapshot.objects_count << "\n";
+        metric("verlet_sub_steps", "gauge", "Sub steps of the last update");
+        out << "verlet_sub_steps " << snapshot.sub_steps << "\n";
+
+        metric("verlet_update_duration_seconds", "summary", "Solver update wall time, quantiles over the recent updates");
+        for (uint32_t q{0}; q < update_quantiles.size(); ++q) {
+            out << "verlet_update_duration_seconds{quantile=\"" << update_quantiles[q] << "\"} " << snapshot.update_ms[q] * 1e-3 << "\n";
+        }
+        out << "verlet_update_duration_seconds_sum " << snapshot.update_seconds_sum << "\n";
+        out << "verlet_update_duration_seconds_count " << snapshot.updates_count << "\n";
+#ifdef VERLET_PROFILING
+        metric("verlet_phase_duration_seconds", "summary", "Duration of the profiler's phase scopes, all threads");
+        for (uint32_t p{0}; p < profiler::phases_count; ++p) {
+            for (uint32_t q{0}; q < phase_quantiles.size(); ++q) {
+                out << "verlet_phase_duration_seconds{phase=\"" << profiler::getName(static_cast<profiler::Phase>(p)) << "\",quantile=\""
+                    << phase_quantiles[q] << "\"} " << snapshot.phase_ms[p][q] * 1e-3 << "\n";
+            }
+        }
+#endif
+        metric("verlet_worker_busy_seconds_total", "counter", "Time spent by each worker running tasks");
+        for (uint32_t w{0}; w < m_thread_pool.m_thread_count; ++w) {
+            out << "verlet_worker_busy_seconds_total{worker=\"" << w << "\"} " << to<double>(m_thread_pool.getBusyTime(w)) * 1e-9 << "\n";
+        }
+
+        metric("verlet_contacts_tested_total", "counter", "Candidate pairs whose distance was checked");
+        out << "verlet_contacts_tested_total " << snapshot.health_total.candidates_tested << "\n";
+        metric("verlet_contacts_resolved_total", "counter", "Overlapping pairs pushed apart");
+        out << "verlet_contacts_resolved_total " << snapshot.health_total.contacts_resolved << "\n";
+        metric("verlet_cell_overflows_total", "counter", "Objects left out of the grid because their cell was full");
+        out << "verlet_cell_overflows_total " << snapshot.health_total.cell_overflows << "\n";
+        metric("verlet_border_skips_total", "counter", "Objects left out of the grid by the safety border");
+        out << "verlet_border_skips_total " << snapshot.health_total.border_skips << "\n";
+        metric("verlet_max_penetration", "gauge", "Deepest overlap of the last update");
+        out << "verlet_max_penetration " << snapshot.health.max_penetration << "\n";
+        return out.str();
+    }
+
+private:
+    struct Connection
+    {
+        int32_t     fd;
+        std::string request;
+        std::string response;
+        uint64_t    offset = 0;
+        bool        closed = false;
+    };
+
+    tp::ThreadPool&          m_thread_pool;
+    // Solver thread side
+    Snapshot                 m_current;
+    std::array<RQuantile<float>, 2> m_update_windows;
+#ifdef VERLET_PROFILING
+    uint64_t                 m_collections_count = 0;
+#endif
+    TripleBuffer<Snapshot>   m_snapshots;
+
+    std::thread              m_thread;
+    std::atomic<bool>        m_running   = false;
+    int32_t                  m_listen_fd = -1;
+    std::string              m_socket_path;
+    std::vector<Connection>  m_connections;
+    uint64_t                 m_scrapes_count = 0;
+
+#ifdef VERLET_METRICS_SOCKETS
+    bool listenOn(int32_t fd, const sockaddr* address, socklen_t address_size)
+    {
+        if (fd < 0 || bind(fd, address, address_size) < 0 || listen(fd, 16) < 0) {
+            std::cerr << "Cannot start metrics server" << std::endl;
+            if (fd >= 0) {
+                close(fd);
+            }
+            return false;
+        }
+        setNonBlocking(fd);
+        m_listen_fd = fd;
+        return true;
+    }
+
+    static void setNonBlocking(int32_t fd)
+    {
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+    }
+
+    void run()
+    {
+        std::vector<pollfd> poll_fds;
+        while (m_running) {
+            poll_fds.clear();
+            poll_fds.push_back({m_listen_fd, POLLIN, 0});
+            for (const Connection& connection : m_connections) {
+                const auto events = static_cast<int16_t>(connection.response.empty() ? POLLIN : POLLOUT);
+                poll_fds.push_back({connection.fd, events, 0});
+            }
+            // The timeout only bounds the time needed to notice a stop request
+            if (poll(poll_fds.data(), static_cast<nfds_t>(poll_fds.size()), 100) < 0) {
+                continue;
+            }
+            for (uint32_t i{0}; i < m_connections.size() && i + 1 < poll_fds.size(); ++i) {
+                const int16_t events = poll_fds[i + 1].revents;
+                Connection& connection = m_connections[i];
+                if (events & (POLLERR | POLLNVAL)) {
+                    connection.closed = true;
+                } else if (events & (POLLIN | POLLHUP)) {
+                    receive(connection);
+                } else if (events & POLLOUT) {
+                    flush(connection);
+                }
+            }
+            if (poll_fds[0].revents & POLLIN) {
+                acceptConnections();
+            }
+            removeClosedConnections();
+        }
+    }
+
+    void acceptConnections()
+    {
+        while (true) {
+            const int32_t fd = accept(m_listen_fd, nullptr, nullptr);
+            if (fd < 0) {
+                return;
+            }
+            setNonBlocking(fd);
+#ifdef SO_NOSIGPIPE
+            const int32_t no_sigpipe = 1;
+            setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &no_sigpipe, sizeof(no_sigpipe));
+#endif
+            m_connections.push_back({fd, {}, {}, 0, false});
+        }
+    }
+
+    // Any request is answered with the metrics once its headers are complete
+    void receive(Connection& connection)
+    {
+        char buffer[1024];
+        const auto received = recv(connection.fd, buffer, sizeof(buffer), 0);
+        if (received <= 0) {
+            connection.closed = received == 0 || (errno != EAGAIN && errno != EWOULDBLOCK);
+            return;
+        }
+        connection.request.append(buffer, static_cast<size_t>(received));
+        if (connection.request.find("\r\n\r\n") == std::string::npos && connection.request.find("\n\n") == std::string::npos) {
+            // Requests are a few hundred bytes, anything larger is not a scraper
+            connection.closed = connection.request.size() > 8192;
+            return;
+        }
+        const std::string body = render();
+        connection.response = "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: " +
+                              std::to_string(body.size()) + "\r\nConnection: close\r\n\r\n" + body;
+        ++m_scrapes_count;
+        flush(connection);
+    }
+
+    void flush(Connection& connection)
+    {
+#ifdef MSG_NOSIGNAL
+        constexpr int32_t flags = MSG_NOSIGNAL;
+#else
+        constexpr int32_t flags = 0;
+#endif
+        while (connection.offset < connection.response.size()) {
+            const auto sent = send(connection.fd, connection.response.data() + connection.offset,
+                                   connection.response.size() - connection.offset, flags);
+            if (sent <= 0) {
+                connection.closed = sent < 0 && errno != EAGAIN && errno != EWOULDBLOCK;
+                return;
+            }
+            connection.offset += static_cast<uint64_t>(sent);
+        }
+        // One response per connection
+        connection.closed = true;
+    }
+
+    void removeClosedConnections()
+    {
+        for (auto it = m_connections.begin(); it != m_connections.end();) {
+            if (it->closed) {
+                close(it->fd);
+                it = m_connections.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+#else
+    void run() {}
+#endif
+};
@@ -15,10 +15,13 @@ struct CollisionCell
 
 	CollisionCell() = default;
 
-	void addAtom(uint32_t id)
+	// Returns false if the cell is full, in this case the atom is not stored
+	bool addAtom(uint32_t id)
 	{
+        const bool stored = objects_count < max_cell_idx;
         objects[objects_count] = id;
-        objects_count += objects_count < max_cell_idx;
+        objects_count += stored;
+        return stored;
 	}
 
 	void clear()
@@ -55,8 +58,7 @@ struct CollisionGrid : public Grid<CollisionCell>
 	{
 		const uint32_t id = x * height + y;
 		// Add to grid
-		data[id].addAtom(atom);
-		return true;
+		return data[id].addAtom(atom);
 	}
 
 	void clear()
@@ -0,0 +1,102 @@
+#pragma once
+#include <functional>
+#include <SFML/Graphics/Color.hpp>
+#include "engine/common/utils.hpp"
+#include "engine/common/math.hpp"
+#include "engine/common/number_generator.hpp"
+#include "engine/common/index_vector.hpp"
+
+
+// Source of new objects, emission itself is done by PhysicSolver::emitObjects
+struct Emitter
+{
+    enum class Shape
+    {
+        // Objects are evenly spaced from position to position + size
+        Line,
+        // Uniformly distributed in the disk of center position and radius size.x
+        Disk,
+        // Uniformly distributed in the box of corner position and extent size
+        Box,
+    };
+
+    using ColorCallback = std::function<sf::Color(civ::ID)>;
+
+    Shape         shape    = Shape::Line;
+    Vec2          position = {0.0f, 0.0f};
+    Vec2          size     = {0.0f, 0.0f};
+    // Objects per second
+    float         rate     = 0.0f;
+    // Initial velocity in world units per second, each component is jittered by up to velocity_jitter
+    Vec2          velocity = {0.0f, 0.0f};
+    float         velocity_jitter = 0.0f;
+    ColorCallback color;
+    bool          enabled  = true;
+    // Emission stops when the solver holds this many objects, 0 means no limit
+    uint32_t      max_objects_count = 0;
+    // New objects closer than min_spacing to an existing one are not created
+    bool          check_free_space = true;
+    float         min_spacing      = 1.0f;
+    uint64_t      seed             = 0;
+
+    // Emission state
+    float         accumulator    = 0.0f;
+    uint64_t      emitted_count  = 0;
+    uint64_t      rejected_count = 0;
+
+    // Number of objects to emit for this update
+    uint32_t getEmissionCount(float dt, uint64_t objects_count)
+    {
+        if (!enabled) {
+            return 0;
+        }
+        accumulator += rate * dt;
+        auto count = to<uint32_t>(accumulator);
+        accumulator -= to<float>(count);
+        if (max_objects_count) {
+            count = to<uint32_t>(std::min<uint64_t>(count, max_objects_count - std::min<uint64_t>(objects_count, max_objects_count)));
+        }
+        return count;
+    }
+
+    // Position of the ith candidate out of count, random shapes draw from the candidate's global index
+    [[nodiscard]]
+    Vec2 samplePosition(uint32_t i, uint32_t count) const
+    {
+        if (shape == Shape::Line) {
+            const float t = count > 1 ? to<float>(i) / to<float>(count - 1) : 0.5f;
+            return position + size * t;
+        }
+        const CounterRNG rng{seed, position_stream};
+        const CounterRNG::Block r = rng.getBlock(getSampledCount() + i);
+        if (shape == Shape::Disk) {
+            const float radius = size.x * std::sqrt(CounterRNG::toFloat(r[0]));
+            const float angle  = 2.0f * Math::PI * CounterRNG::toFloat(r[1]);
+            return position + Vec2{std::cos(angle), std::sin(angle)} * radius;
+        }
+        return position + Vec2{size.x * CounterRNG::toFloat(r[0]), size.y * CounterRNG::toFloat(r[1])};
+    }
+
+    // Velocity of the ith object created by this emission
+    [[nodiscard]]
+    Vec2 sampleVelocity(uint32_t i) const
+    {
+        if (velocity_jitter == 0.0f) {
+            return velocity;
+        }
+        const CounterRNG rng{seed, velocity_stream};
+        const CounterRNG::Block r = rng.getBlock(emitted_count + i);
+        return velocity + Vec2{(2.0f * CounterRNG::toFloat(r[0]) - 1.0f) * velocity_jitter,
+                               (2.0f * CounterRNG::toFloat(r[1]) - 1.0f) * velocity_jitter};
+    }
+
+    [[nodiscard]]
+    uint64_t getSampledCount() const
+    {
+        return emitted_count + rejected_count;
+    }
+
+private:
+    static constexpr uint32_t position_stream = 0;
+    static constexpr uint32_t velocity_stream = 1;
+};
@@ -4,12 +4,23 @@
 #include "engine/common/math.hpp"
 
 
+// Compact mode also stores objects' ids and validity counters on 32 bits
+#ifndef VERLET_COMPACT_OBJECTS
+using ObjectIndex = uint64_t;
+#else
+using ObjectIndex = uint32_t;
+#endif
+
+
 struct PhysicObject
 {
     // Verlet
     Vec2 position      = {0.0f, 0.0f};
     Vec2 last_position = {0.0f, 0.0f};
+#ifndef VERLET_COMPACT_OBJECTS
+    // In compact mode (20 bytes instead of 28) accelerations are not accumulated, they are given to update()
     Vec2 acceleration  = {0.0f, 0.0f};
+#endif
     sf::Color color;
 
     PhysicObject() = default;
@@ -26,16 +37,21 @@ struct PhysicObject
         last_position = pos;
     }
 
-    void update(float dt)
+    void update(float dt, Vec2 external_acceleration = {0.0f, 0.0f})
     {
         const Vec2 last_update_move = position - last_position;
 
         const float VELOCITY_DAMPING = 40.0f; // arbitrary, approximating air friction
 
-        const Vec2 new_position = position + last_update_move + (acceleration - last_update_move * VELOCITY_DAMPING) * (dt * dt);
+#ifndef VERLET_COMPACT_OBJECTS
+        const Vec2 total_acceleration = acceleration + external_acceleration;
+        acceleration = {0.0f, 0.0f};
+#else
+        const Vec2 total_acceleration = external_acceleration;
+#endif
+        const Vec2 new_position = position + last_update_move + (total_acceleration - last_update_move * VELOCITY_DAMPING) * (dt * dt);
         last_position           = position;
         position                = new_position;
-        acceleration = {0.0f, 0.0f};
     }
 
     void stop()
@@ -1,77 +1,208 @@
 #pragma once
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <iostream>
 #include "collision_grid.hpp"
+#include "emitter.hpp"
 #include "physic_object.hpp"
+#include "solver_kernels.hpp"
+#include "temporal_blocking.hpp"
 #include "engine/common/utils.hpp"
+#include "engine/common/huge_page_allocator.hpp"
 #include "engine/common/index_vector.hpp"
+#include "profiler/profiler.hpp"
 #include "thread_pool/thread_pool.hpp"
+#include "thread_pool/task_graph.hpp"
+
+
+// Bounds used to select the sub steps count each frame when adaptive mode is on
+struct AdaptiveSubSteps
+{
+    bool     enabled          = false;
+    uint32_t min_sub_steps    = 2;
+    uint32_t max_sub_steps    = 32;
+    // Maximum distance an object should travel during a single sub step
+    float    max_displacement = 0.25f;
+    // Maximum overlap depth tolerated between two objects (radius is 0.5)
+    float    max_overlap      = 0.4f;
+    // CPU time allowed for one update in milliseconds, 0 means no budget
+    float    time_budget_ms   = 0.0f;
+};
+
+
+// Workload of the last update, to relate throughput changes to what the solver had to do
+struct SolverHealth
+{
+    // Pairs whose distance was checked, and among them pairs that were overlapping
+    uint64_t candidates_tested = 0;
+    uint64_t contacts_resolved = 0;
+    // Deepest overlap found between two objects (radius is 0.5)
+    float    max_penetration   = 0.0f;
+    // Objects left out of the grid because their cell was full, or because of the safety border,
+    // summed over the sub steps
+    uint64_t cell_overflows    = 0;
+    uint64_t border_skips      = 0;
+};
+
+
+enum class UpdateMode
+{
+    // Each sub step sweeps all objects in three phases separated by global barriers
+    Barrier,
+    // Several sub steps are performed on cache sized tiles, see TemporalBlocking
+    TemporalBlocking,
+    // Each grid stripe is processed as soon as the stripes it depends on are done
+    TaskGraph,
+};
 
 
 struct PhysicSolver
 {
-    CIVector<PhysicObject> objects;
-    CollisionGrid          grid;
-    Vec2                   world_size;
-    Vec2                   gravity = {0.0f, 20.0f};
+    CIVector<PhysicObject, ObjectIndex, HugePageAllocator> objects;
+    CollisionGrid                                          grid;
+    Vec2                                                   world_size;
+    Vec2                                                   gravity = {0.0f, 20.0f};
 
     // Simulation solving pass count
-    uint32_t        sub_steps;
-    tp::ThreadPool& thread_pool;
+    uint32_t         sub_steps;
+    AdaptiveSubSteps adaptive;
+    UpdateMode       mode = UpdateMode::Barrier;
+    TemporalBlocking temporal_blocking;
+    tp::ThreadPool&  thread_pool;
+    // Collision tasks per thread and pass, see setCollisionTasksPerThread
+    uint32_t         collision_tasks_per_thread = 1;
+    // Objects count at the last placeMemory, placement is refreshed when it grew significantly
+    uint32_t         placed_objects_count = 0;
+    bool             memory_outdated      = true;
+
+    // Sub step pipeline used by the TaskGraph mode, built on first use
+    tp::TaskGraph         sub_step_graph;
+    float                 sub_step_dt = 0.0f;
+    // Objects that are not in the grid because of the safety border or a full cell
+    std::vector<uint32_t> grid_orphans;
+    // Objects flagged by removeObjects, indexed by position in data
+    std::vector<uint8_t>  removal_flags;
+    // Set when the grid no longer matches objects, it is then rebuilt before spatial queries
+    bool                  grid_outdated = true;
+    // Set once objects' ids or validity counters overflowed ObjectIndex, see checkIndexOverflow
+    bool                  index_overflow_reported = false;
+
+    // Emitted at the beginning of each update
+    std::vector<Emitter>  emitters;
+    std::vector<Vec2>     emission_positions;
+    std::vector<uint8_t>  emission_flags;
+
+    // Measures from the last update, used to pick the next sub steps count
+    std::vector<ContactStats> contact_stats;
+    // Filled by addObjectsToGrid, which never runs concurrently with collision tasks
+    ContactStats              grid_stats;
+    SolverHealth              health;
+    std::atomic<float>        max_speed        = 0.0f;
+    float                     last_max_speed   = 0.0f;
+    float                     last_max_overlap = 0.0f;
+    float                     last_update_ms   = 0.0f;
+
+    // Called at the end of each update, on the thread running the solver
+    std::vector<std::function<void(const PhysicSolver&)>> update_callbacks;
 
     PhysicSolver(IVec2 size, tp::ThreadPool& tp)
         : grid{size.x, size.y}
         , world_size{to<float>(size.x), to<float>(size.y)}
         , sub_steps{8}
         , thread_pool{tp}
+        , contact_stats(2 * tp.m_thread_count + 1)
     {
         grid.clear();
     }
 
-    // Checks if two atoms are colliding and if so create a new contact
-    void solveContact(uint32_t atom_1_idx, uint32_t atom_2_idx)
+    // Changes the world's dimensions, objects are kept as they are
+    void resize(IVec2 size)
+    {
+        grid       = CollisionGrid{size.x, size.y};
+        world_size = {to<float>(size.x), to<float>(size.y)};
+        grid.clear();
+        grid_outdated = true;
+        // Stripes of the task graph depend on the grid's dimensions
+        sub_step_graph.clear();
+        memory_outdated = true;
+    }
+
+    // More, thinner stripes than threads balance uneven densities at the cost of more tasks
+    void setCollisionTasksPerThread(uint32_t count)
+    {
+        collision_tasks_per_thread = std::max(1u, count);
+        contact_stats.resize(2 * getCollisionTasksCount() + 1);
+        sub_step_graph.clear();
+        memory_outdated = true;
+    }
+
+    [[nodiscard]]
+    uint32_t getCollisionTasksCount() const
     {
-        constexpr float response_coef = 1.0f;
-        constexpr float eps           = 0.0001f;
-        PhysicObject& obj_1 = objects.data[atom_1_idx];
-        PhysicObject& obj_2 = objects.data[atom_2_idx];
-        const Vec2 o2_o1  = obj_1.position - obj_2.position;
-        const float dist2 = o2_o1.x * o2_o1.x + o2_o1.y * o2_o1.y;
-        if (dist2 < 1.0f && dist2 > eps) {
-            const float dist          = sqrt(dist2);
-            // Radius are all equal to 1.0f
-            const float delta  = response_coef * 0.5f * (1.0f - dist);
-            const Vec2 col_vec = (o2_o1 / dist) * delta;
-            obj_1.position += col_vec;
-            obj_2.position -= col_vec;
+        return thread_pool.m_thread_count * collision_tasks_per_thread;
+    }
+
+    // Stripes 2i and 2i + 1 form collision task i, consecutive tasks share a worker. The
+    // remaining cells' stripe goes to the last worker.
+    [[nodiscard]]
+    uint32_t getStripeWorker(uint32_t stripe) const
+    {
+        return std::min(stripe / 2 / collision_tasks_per_thread, thread_pool.m_thread_count - 1);
+    }
+
+    // With pinned workers, moves grid stripes and objects to the NUMA node of the worker owning
+    // them: stripes as in solveCollisions, objects as batched by updateObjects_multi
+    void placeMemory()
+    {
+        placed_objects_count = to<uint32_t>(objects.size());
+        memory_outdated      = false;
+        if (!thread_pool.isPinned()) {
+            return;
         }
+        const uint32_t slice_size = std::max(1u, (grid.width / (getCollisionTasksCount() * 2)) * grid.height);
+        tp::CpuTopology::place(grid.data.data(), grid.data.size(), [&](uint64_t cell) {
+            return thread_pool.getWorkerNode(getStripeWorker(to<uint32_t>(cell / slice_size)));
+        });
+        const uint32_t batch_size = std::max(1u, placed_objects_count / thread_pool.m_thread_count);
+        tp::CpuTopology::place(objects.data.data(), placed_objects_count, [&](uint64_t index) {
+            return thread_pool.getWorkerNode(std::min(to<uint32_t>(index / batch_size), thread_pool.m_thread_count - 1));
+        });
     }
 
-    void checkAtomCellCollisions(uint32_t atom_idx, const CollisionCell& c)
+    // Checks if two atoms are colliding and if so create a new contact
+    void solveContact(uint32_t atom_1_idx, uint32_t atom_2_idx, ContactStats& stats)
+    {
+        SolverKernels::solveContact(objects.data[atom_1_idx], objects.data[atom_2_idx], stats);
+    }
+
+    void checkAtomCellCollisions(uint32_t atom_idx, const CollisionCell& c, ContactStats& stats)
     {
         for (uint32_t i{0}; i < c.objects_count; ++i) {
-            solveContact(atom_idx, c.objects[i]);
+            solveContact(atom_idx, c.objects[i], stats);
         }
     }
 
-    void processCell(const CollisionCell& c, uint32_t index)
+    void processCell(const CollisionCell& c, uint32_t index, ContactStats& stats)
     {
         for (uint32_t i{0}; i < c.objects_count; ++i) {
             const uint32_t atom_idx = c.objects[i];
-            checkAtomCellCollisions(atom_idx, grid.data[index - 1]);
-            checkAtomCellCollisions(atom_idx, grid.data[index]);
-            checkAtomCellCollisions(atom_idx, grid.data[index + 1]);
-            checkAtomCellCollisions(atom_idx, grid.data[index + grid.height - 1]);
-            checkAtomCellCollisions(atom_idx, grid.data[index + grid.height    ]);
-            checkAtomCellCollisions(atom_idx, grid.data[index + grid.height + 1]);
-            checkAtomCellCollisions(atom_idx, grid.data[index - grid.height - 1]);
-            checkAtomCellCollisions(atom_idx, grid.data[index - grid.height    ]);
-            checkAtomCellCollisions(atom_idx, grid.data[index - grid.height + 1]);
+            checkAtomCellCollisions(atom_idx, grid.data[index - 1], stats);
+            checkAtomCellCollisions(atom_idx, grid.data[index], stats);
+            checkAtomCellCollisions(atom_idx, grid.data[index + 1], stats);
+            checkAtomCellCollisions(atom_idx, grid.data[index + grid.height - 1], stats);
+            checkAtomCellCollisions(atom_idx, grid.data[index + grid.height    ], stats);
+            checkAtomCellCollisions(atom_idx, grid.data[index + grid.height + 1], stats);
+            checkAtomCellCollisions(atom_idx, grid.data[index - grid.height - 1], stats);
+            checkAtomCellCollisions(atom_idx, grid.data[index - grid.height    ], stats);
+            checkAtomCellCollisions(atom_idx, grid.data[index - grid.height + 1], stats);
         }
     }
 
-    void solveCollisionThreaded(uint32_t start, uint32_t end)
+    void solveCollisionThreaded(uint32_t start, uint32_t end, ContactStats& stats)
     {
         for (uint32_t idx{start}; idx < end; ++idx) {
-            processCell(grid.data[idx], idx);
+            processCell(grid.data[idx], idx, stats);
         }
     }
 
@@ -79,97 +210,410 @@ struct PhysicSolver
     void solveCollisions()
     {
         // Multi-thread grid
-        const uint32_t thread_count = thread_pool.m_thread_count;
-        const uint32_t slice_count  = thread_count * 2;
-        const uint32_t slice_size   = (grid.width / slice_count) * grid.height;
-        const uint32_t last_cell    = (2 * (thread_count - 1) + 2) * slice_size;
+        const uint32_t tasks_count = getCollisionTasksCount();
+        const uint32_t slice_count = tasks_count * 2;
+        const uint32_t slice_size  = (grid.width / slice_count) * grid.height;
+        const uint32_t last_cell   = (2 * (tasks_count - 1) + 2) * slice_size;
         // Find collisions in two passes to avoid data races
+        tp::TaskGroup group;
 
         // First collision pass
-        for (uint32_t i{0}; i < thread_count; ++i) {
-            thread_pool.addTask([this, i, slice_size]{
+        for (uint32_t i{0}; i < tasks_count; ++i) {
+            thread_pool.addTask(group, getStripeWorker(2 * i), [this, i, slice_size]{
+                VERLET_PROFILE_SCOPE(profiler::Phase::CollisionPass1);
                 uint32_t const start{2 * i * slice_size};
                 uint32_t const end  {start + slice_size};
-                solveCollisionThreaded(start, end);
+                solveCollisionThreaded(start, end, contact_stats[i]);
             });
         }
         // Eventually process rest if the world is not divisible by the thread count
         if (last_cell < grid.data.size()) {
-            thread_pool.addTask([this, last_cell]{
-                solveCollisionThreaded(last_cell, to<uint32_t>(grid.data.size()));
+            thread_pool.addTask(group, getStripeWorker(2 * tasks_count), [this, last_cell, tasks_count]{
+                VERLET_PROFILE_SCOPE(profiler::Phase::CollisionPass1);
+                solveCollisionThreaded(last_cell, to<uint32_t>(grid.data.size()), contact_stats[tasks_count]);
             });
         }
-        thread_pool.waitForCompletion();
+        group.wait();
         // Second collision pass
-        for (uint32_t i{0}; i < thread_count; ++i) {
-            thread_pool.addTask([this, i, slice_size]{
+        for (uint32_t i{0}; i < tasks_count; ++i) {
+            thread_pool.addTask(group, getStripeWorker(2 * i), [this, i, slice_size]{
+                VERLET_PROFILE_SCOPE(profiler::Phase::CollisionPass2);
                 uint32_t const start{(2 * i + 1) * slice_size};
                 uint32_t const end  {start + slice_size};
-                solveCollisionThreaded(start, end);
+                solveCollisionThreaded(start, end, contact_stats[i]);
             });
         }
-        thread_pool.waitForCompletion();
+        group.wait();
     }
 
     // Add a new object to the solver
     uint64_t addObject(const PhysicObject& object)
     {
-        return objects.push_back(object);
+        grid_outdated = true;
+        const uint64_t id = objects.push_back(object);
+        checkIndexOverflow();
+        return id;
     }
 
     // Add a new object to the solver
     uint64_t createObject(Vec2 pos)
     {
-        return objects.emplace_back(pos);
+        grid_outdated = true;
+        const uint64_t id = objects.emplace_back(pos);
+        checkIndexOverflow();
+        return id;
+    }
+
+    // Adds count objects at once, init(id, object) is called to set each of them up
+    template<typename TCallback>
+    void createObjects(uint32_t count, TCallback&& init)
+    {
+        grid_outdated = true;
+        objects.emplace_back_n(count, std::forward<TCallback>(init));
+        checkIndexOverflow();
+    }
+
+    // Returns false once objects' ids or validity counters no longer fit in ObjectIndex: stale
+    // references may then look valid. This is reported once and emitters stop creating objects.
+    bool checkIndexOverflow()
+    {
+        if (!objects.hasIndexOverflow()) {
+            return true;
+        }
+        if (!index_overflow_reported) {
+            index_overflow_reported = true;
+            std::cerr << "Objects ids overflowed their " << 8 * sizeof(ObjectIndex)
+                      << " bits index, emission stopped" << std::endl;
+        }
+        return false;
+    }
+
+    // Removes objects matching the predicate, it is evaluated in parallel and must be thread safe
+    template<typename TPredicate>
+    void removeObjects(TPredicate&& predicate)
+    {
+        const auto objects_count = to<uint32_t>(objects.size());
+        removal_flags.resize(objects_count);
+        thread_pool.dispatch(objects_count, [&](uint32_t start, uint32_t end) {
+            for (uint32_t i{start}; i < end; ++i) {
+                removal_flags[i] = predicate(objects.data[i]);
+            }
+        });
+        objects.remove_marked(removal_flags);
+        grid_outdated = true;
+    }
+
+    // Returns true if no object of the grid is closer than min_distance (at most one cell) from position.
+    // The grid has to be up to date, see emitObjects.
+    [[nodiscard]]
+    bool isFreeSpace(Vec2 position, float min_distance) const
+    {
+        if (!SolverKernels::isInGrid(position, world_size)) {
+            return false;
+        }
+        const float    min_distance2 = min_distance * min_distance;
+        const uint32_t center = to<uint32_t>(position.x) * grid.height + to<uint32_t>(position.y);
+        for (int32_t dx{-1}; dx <= 1; ++dx) {
+            for (int32_t dy{-1}; dy <= 1; ++dy) {
+                const CollisionCell& c = grid.data[center + dx * grid.height + dy];
+                for (uint32_t i{0}; i < c.objects_count; ++i) {
+                    const Vec2 v = objects.data[c.objects[i]].position - position;
+                    if (v.x * v.x + v.y * v.y < min_distance2) {
+                        return false;
+                    }
+                }
+            }
+        }
+        return true;
+    }
+
+    // Creates the objects of an emitter for this update. Candidates are sampled and checked
+    // against the grid in parallel, the accepted ones are added with a single reservation
+    // and their attributes are filled in parallel. Random draws are keyed by the emitter's
+    // seed and objects' emission index so the result does not depend on the threads count.
+    void emitObjects(Emitter& emitter, float dt)
+    {
+        const uint32_t count = emitter.getEmissionCount(dt, objects.size());
+        if (!count || !checkIndexOverflow()) {
+            return;
+        }
+        VERLET_PROFILE_SCOPE(profiler::Phase::Emission);
+        if (emitter.check_free_space && grid_outdated) {
+            // Not a sub step, its orphans are not part of the solver's health
+            const ContactStats stats = grid_stats;
+            addObjectsToGrid();
+            grid_stats = stats;
+        }
+        emission_positions.resize(count);
+        emission_flags.resize(count);
+        thread_pool.dispatch(count, [&](uint32_t start, uint32_t end) {
+            for (uint32_t i{start}; i < end; ++i) {
+                emission_positions[i] = emitter.samplePosition(i, count);
+                emission_flags[i]     = !emitter.check_free_space || isFreeSpace(emission_positions[i], emitter.min_spacing);
+            }
+        });
+        // Candidates are not in the grid, they are checked against each other here.
+        // Batches are a single update worth of emission so this stays small.
+        uint32_t accepted = 0;
+        const float min_spacing2 = emitter.min_spacing * emitter.min_spacing;
+        for (uint32_t i{0}; i < count; ++i) {
+            bool free = emission_flags[i];
+            for (uint32_t k{0}; free && emitter.check_free_space && k < accepted; ++k) {
+                const Vec2 v = emission_positions[k] - emission_positions[i];
+                free = v.x * v.x + v.y * v.y >= min_spacing2;
+            }
+            if (free) {
+                emission_positions[accepted++] = emission_positions[i];
+            }
+        }
+
+        // New objects are appended at the end of data
+        const auto first = to<uint32_t>(objects.size());
+        createObjects(accepted, [](civ::ID, PhysicObject&) {});
+        const float velocity_scale = dt / to<float>(sub_steps);
+        thread_pool.dispatch(accepted, [&](uint32_t start, uint32_t end) {
+            for (uint32_t i{start}; i < end; ++i) {
+                PhysicObject& object = objects.data[first + i];
+                object.setPosition(emission_positions[i]);
+                object.addVelocity(emitter.sampleVelocity(i) * velocity_scale);
+                if (emitter.color) {
+                    object.color = emitter.color(objects.getID(first + i));
+                }
+            }
+        });
+        emitter.emitted_count  += accepted;
+        emitter.rejected_count += count - accepted;
     }
 
     void update(float dt)
     {
+        const auto update_start = std::chrono::steady_clock::now();
+        for (ContactStats& stats : contact_stats) {
+            stats.reset();
+        }
+        grid_stats.reset();
+        max_speed = 0.0f;
+        if (memory_outdated || objects.size() > placed_objects_count + std::max(placed_objects_count / 4, 1024u)) {
+            placeMemory();
+        }
+        for (Emitter& emitter : emitters) {
+            emitObjects(emitter, dt);
+        }
         // Perform the sub steps
         const float sub_dt = dt / static_cast<float>(sub_steps);
+        if (mode == UpdateMode::TemporalBlocking) {
+            updateTemporalBlocking(sub_dt);
+            // Tiles are solved with their own grids
+            grid_outdated = true;
+        } else if (mode == UpdateMode::TaskGraph) {
+            updateTaskGraph(sub_dt);
+        } else {
+            for (uint32_t i(sub_steps); i--;) {
+                VERLET_PROFILE_SCOPE(profiler::Phase::SubStep);
+                addObjectsToGrid();
+                solveCollisions();
+                updateObjects_multi(sub_dt);
+            }
+        }
+        const std::chrono::duration<float, std::milli> elapsed = std::chrono::steady_clock::now() - update_start;
+        last_update_ms   = elapsed.count();
+        last_max_speed   = max_speed;
+        ContactStats total = grid_stats;
+        for (const ContactStats& stats : contact_stats) {
+            total.add(stats);
+        }
+        last_max_overlap = total.max_overlap;
+        health.candidates_tested = total.tested;
+        health.contacts_resolved = total.resolved;
+        health.max_penetration   = total.max_overlap;
+        health.cell_overflows    = total.cell_overflows;
+        health.border_skips      = total.border_skips;
+        if (adaptive.enabled) {
+            setSubSteps(computeSubSteps());
+        }
+        for (const auto& callback : update_callbacks) {
+            callback(*this);
+        }
+    }
+
+    // Velocities are implicit displacements per sub step, they are rescaled so that objects keep
+    // their real speed when the sub step duration changes
+    void setSubSteps(uint32_t count)
+    {
+        count = std::max(1u, count);
+        if (count == sub_steps) {
+            return;
+        }
+        const float scale = to<float>(sub_steps) / to<float>(count);
+        thread_pool.dispatch(to<uint32_t>(objects.size()), [&](uint32_t start, uint32_t end) {
+            for (uint32_t i{start}; i < end; ++i) {
+                PhysicObject& object = objects.data[i];
+                object.last_position = object.position - (object.position - object.last_position) * scale;
+            }
+        });
+        sub_steps = count;
+    }
+
+    // Picks the sub steps count for the next frame from the last frame's measures.
+    // Displacement and overlap both scale with the sub step duration so the current
+    // count is rescaled to bring them under their thresholds. Calm frames, below
+    // the hysteresis band, only give back one step at a time to avoid oscillations.
+    [[nodiscard]]
+    uint32_t computeSubSteps() const
+    {
+        constexpr float hysteresis = 0.75f;
+        const auto  current       = to<float>(sub_steps);
+        const float speed_ratio   = last_max_speed / adaptive.max_displacement;
+        const float overlap_ratio = last_max_overlap / adaptive.max_overlap;
+        const float ratio         = std::max(speed_ratio, overlap_ratio);
+        uint32_t target = sub_steps;
+        if (ratio > 1.0f) {
+            // Growth is limited to avoid a single violent frame pushing directly to the maximum
+            target = std::min(to<uint32_t>(std::ceil(current * ratio)), sub_steps + std::max(1u, sub_steps / 4));
+        } else if (ratio < hysteresis && sub_steps > 1) {
+            target = sub_steps - 1;
+        }
+        if (adaptive.time_budget_ms > 0.0f && last_update_ms > 0.0f) {
+            const float step_ms = last_update_ms / current;
+            target = std::min(target, to<uint32_t>(adaptive.time_budget_ms / step_ms));
+        }
+        return std::min(std::max(target, adaptive.min_sub_steps), adaptive.max_sub_steps);
+    }
+
+    void updateTemporalBlocking(float sub_dt)
+    {
+        temporal_blocking.resetStats();
+        for (uint32_t remaining{sub_steps}; remaining;) {
+            const uint32_t steps = std::min(remaining, temporal_blocking.steps_per_pass);
+            temporal_blocking.update(objects.data.data(), to<uint32_t>(objects.size()), world_size, gravity, sub_dt, steps, thread_pool);
+            remaining -= steps;
+        }
+        contact_stats[0] = temporal_blocking.getStats();
+        max_speed                    = temporal_blocking.getMaxSpeed();
+    }
+
+    void updateTaskGraph(float sub_dt)
+    {
+        if (sub_step_graph.empty()) {
+            buildSubStepGraph();
+        }
+        sub_step_dt = sub_dt;
         for (uint32_t i(sub_steps); i--;) {
+            VERLET_PROFILE_SCOPE(profiler::Phase::SubStep);
+            sub_step_graph.run(thread_pool);
+        }
+    }
+
+    // Expresses one sub step as per stripe dependency chains using the same stripes as solveCollisions.
+    // Even stripes are collided after the grid is built, odd stripes as soon as their two neighbors are done,
+    // and objects of a stripe are integrated once no collision task can touch them anymore.
+    void buildSubStepGraph()
+    {
+        const uint32_t slice_count  = getCollisionTasksCount() * 2;
+        const uint32_t slice_size   = (grid.width / slice_count) * grid.height;
+        const auto     cells_count  = to<uint32_t>(grid.data.size());
+        // The remaining cells, if any, form an extra even stripe
+        const uint32_t stripes_count = slice_count + (slice_count * slice_size < cells_count);
+
+        sub_step_graph.clear();
+        const uint32_t grid_node = sub_step_graph.addNode([this]{
             addObjectsToGrid();
-            solveCollisions();
-            updateObjects_multi(sub_dt);
+        });
+        std::vector<uint32_t> collision_nodes(stripes_count);
+        for (uint32_t s{0}; s < stripes_count; ++s) {
+            const uint32_t start = s * slice_size;
+            const uint32_t end   = (s == slice_count) ? cells_count : start + slice_size;
+            collision_nodes[s] = sub_step_graph.addNode([this, s, start, end]{
+                VERLET_PROFILE_SCOPE(s % 2 ? profiler::Phase::CollisionPass2 : profiler::Phase::CollisionPass1);
+                solveCollisionThreaded(start, end, contact_stats[s]);
+            }, to<int32_t>(getStripeWorker(s)));
+        }
+        for (uint32_t s{0}; s < stripes_count; ++s) {
+            if (s % 2 == 0) {
+                sub_step_graph.addDependency(grid_node, collision_nodes[s]);
+            } else {
+                sub_step_graph.addDependency(collision_nodes[s - 1], collision_nodes[s]);
+                if (s + 1 < stripes_count) {
+                    sub_step_graph.addDependency(collision_nodes[s + 1], collision_nodes[s]);
+                }
+            }
+        }
+        for (uint32_t s{0}; s < stripes_count; ++s) {
+            const uint32_t start = s * slice_size;
+            const uint32_t end   = (s == slice_count) ? cells_count : start + slice_size;
+            const uint32_t integration_node = sub_step_graph.addNode([this, start, end]{
+                integrateCells(start, end);
+            }, to<int32_t>(getStripeWorker(s)));
+            // Stripe s objects are touched by the collision tasks of stripes s - 1, s and s + 1
+            for (uint32_t n{s ? s - 1 : 0}; n <= std::min(s + 1, stripes_count - 1); ++n) {
+                sub_step_graph.addDependency(collision_nodes[n], integration_node);
+            }
+        }
+        // Objects outside the grid do not collide, they only have to wait for the grid to be built
+        const uint32_t orphans_node = sub_step_graph.addNode([this]{
+            VERLET_PROFILE_SCOPE(profiler::Phase::Integration);
+            float max_displacement2 = 0.0f;
+            for (const uint32_t id : grid_orphans) {
+                const float displacement2 = SolverKernels::integrate(objects.data[id], gravity, world_size, sub_step_dt);
+                max_displacement2 = std::max(max_displacement2, displacement2);
+            }
+            updateMaxSpeed(max_displacement2);
+        });
+        sub_step_graph.addDependency(grid_node, orphans_node);
+    }
+
+    void integrateCells(uint32_t start, uint32_t end)
+    {
+        VERLET_PROFILE_SCOPE(profiler::Phase::Integration);
+        float max_displacement2 = 0.0f;
+        for (uint32_t idx{start}; idx < end; ++idx) {
+            const CollisionCell& c = grid.data[idx];
+            for (uint32_t i{0}; i < c.objects_count; ++i) {
+                const float displacement2 = SolverKernels::integrate(objects.data[c.objects[i]], gravity, world_size, sub_step_dt);
+                max_displacement2 = std::max(max_displacement2, displacement2);
+            }
         }
+        updateMaxSpeed(max_displacement2);
     }
 
     void addObjectsToGrid()
     {
+        VERLET_PROFILE_SCOPE(profiler::Phase::Grid);
         grid.clear();
+        grid_orphans.clear();
+        grid_outdated = false;
         // Safety border to avoid adding object outside the grid
-        uint32_t i{0};
-        for (const PhysicObject& obj : objects.data) {
-            if (obj.position.x > 1.0f && obj.position.x < world_size.x - 1.0f &&
-                obj.position.y > 1.0f && obj.position.y < world_size.y - 1.0f) {
-                grid.addAtom(to<int32_t>(obj.position.x), to<int32_t>(obj.position.y), i);
+        const auto objects_count = to<uint32_t>(objects.size());
+        for (uint32_t i{0}; i < objects_count; ++i) {
+            const PhysicObject& obj = objects.data[i];
+            if (!SolverKernels::isInGrid(obj.position, world_size)) {
+                ++grid_stats.border_skips;
+                grid_orphans.push_back(i);
+            } else if (!grid.addAtom(to<int32_t>(obj.position.x), to<int32_t>(obj.position.y), i)) {
+                ++grid_stats.cell_overflows;
+                grid_orphans.push_back(i);
             }
-            ++i;
         }
     }
 
+    // Only one atomic operation per task
+    void updateMaxSpeed(float max_displacement2)
+    {
+        const float task_speed = std::sqrt(max_displacement2);
+        float current = max_speed;
+        while (task_speed > current && !max_speed.compare_exchange_weak(current, task_speed));
+    }
+
     void updateObjects_multi(float dt)
     {
         thread_pool.dispatch(to<uint32_t>(objects.size()), [&](uint32_t start, uint32_t end){
+            VERLET_PROFILE_SCOPE(profiler::Phase::Integration);
+            float slice_max_displacement2 = 0.0f;
             for (uint32_t i{start}; i < end; ++i) {
-                PhysicObject& obj = objects.data[i];
-                // Add gravity
-                obj.acceleration += gravity;
-                // Apply Verlet integration
-                obj.update(dt);
-                // Apply map borders collisions
-                const float margin = 2.0f;
-                if (obj.position.x > world_size.x - margin) {
-                    obj.position.x = world_size.x - margin;
-                } else if (obj.position.x < margin) {
-                    obj.position.x = margin;
-                }
-                if (obj.position.y > world_size.y - margin) {
-                    obj.position.y = world_size.y - margin;
-                } else if (obj.position.y < margin) {
-                    obj.position.y = margin;
-                }
+                const float displacement2 = SolverKernels::integrate(objects.data[i], gravity, world_size, dt);
+                slice_max_displacement2 = std::max(slice_max_displacement2, displacement2);
             }
+            updateMaxSpeed(slice_max_displacement2);
         });
     }
 };
@@ -0,0 +1,86 @@
+#pragma once
+#include "physic_object.hpp"
+
+
+// Per task collision statistics, each collision task owns one, on its own cache line, to avoid sharing
+struct alignas(64) ContactStats
+{
+    float    max_overlap     = 0.0f;
+    // Pairs whose distance was checked, and among them pairs that were overlapping
+    uint64_t tested          = 0;
+    uint64_t resolved        = 0;
+    // Objects left out of a grid because their cell was full, or because of the safety border
+    uint64_t cell_overflows  = 0;
+    uint64_t border_skips    = 0;
+
+    void reset()
+    {
+        max_overlap    = 0.0f;
+        tested         = 0;
+        resolved       = 0;
+        cell_overflows = 0;
+        border_skips   = 0;
+    }
+
+    void add(const ContactStats& other)
+    {
+        max_overlap     = std::max(max_overlap, other.max_overlap);
+        tested         += other.tested;
+        resolved       += other.resolved;
+        cell_overflows += other.cell_overflows;
+        border_skips   += other.border_skips;
+    }
+};
+
+
+// Elementary operations shared by the different solver update modes
+struct SolverKernels
+{
+    // Checks if two atoms are colliding and if so pushes them apart
+    static void solveContact(PhysicObject& obj_1, PhysicObject& obj_2, ContactStats& stats)
+    {
+        constexpr float response_coef = 1.0f;
+        constexpr float eps           = 0.0001f;
+        const Vec2 o2_o1  = obj_1.position - obj_2.position;
+        const float dist2 = o2_o1.x * o2_o1.x + o2_o1.y * o2_o1.y;
+        ++stats.tested;
+        if (dist2 < 1.0f && dist2 > eps) {
+            ++stats.resolved;
+            const float dist    = sqrt(dist2);
+            // Radius are all equal to 1.0f
+            const float overlap = 1.0f - dist;
+            const float delta   = response_coef * 0.5f * overlap;
+            const Vec2 col_vec  = (o2_o1 / dist) * delta;
+            obj_1.position += col_vec;
+            obj_2.position -= col_vec;
+            stats.max_overlap = std::max(stats.max_overlap, overlap);
+        }
+    }
+
+    // Applies gravity, Verlet integration and map borders, returns the squared displacement
+    static float integrate(PhysicObject& obj, Vec2 gravity, Vec2 world_size, float dt)
+    {
+        // Apply Verlet integration with gravity
+        obj.update(dt, gravity);
+        // Apply map borders collisions
+        const float margin = 2.0f;
+        if (obj.position.x > world_size.x - margin) {
+            obj.position.x = world_size.x - margin;
+        } else if (obj.position.x < margin) {
+            obj.position.x = margin;
+        }
+        if (obj.position.y > world_size.y - margin) {
+            obj.position.y = world_size.y - margin;
+        } else if (obj.position.y < margin) {
+            obj.position.y = margin;
+        }
+        return MathVec2::length2(obj.getVelocity());
+    }
+
+    // Objects too close to the world's border are not added to the grid
+    static bool isInGrid(Vec2 position, Vec2 world_size)
+    {
+        return position.x > 1.0f && position.x < world_size.x - 1.0f &&
+               position.y > 1.0f && position.y < world_size.y - 1.0f;
+    }
+};
@@ -0,0 +1,267 @@
+#pragma once
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <type_traits>
+#include "physics.hpp"
+
+#if defined(__unix__) || defined(__APPLE__)
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+    #define VERLET_STATE_FILE_MMAP 1
+#endif
+
+
+// Binary snapshot of the solver's state, used to start directly from a settled scene.
+// Layout: Header, then objects slots, ids and slots metadata, each section 64 bytes aligned.
+// Objects are stored as they are in memory, the file is only valid on the same architecture.
+struct StateFile
+{
+    static constexpr uint32_t magic     = 0x54534C56; // "VLST"
+    static constexpr uint32_t version   = 2;
+    static constexpr uint64_t alignment = 64;
+    // 64M cells of the collision grid, about 1.3 GB, larger worlds are taken as corrupted sizes
+    static constexpr uint64_t max_world_cells = uint64_t{1} << 26;
+
+    struct Header
+    {
+        uint32_t magic;
+        uint32_t version;
+        // Sizes of stored types, a mismatch means the file was written by an incompatible build
+        uint32_t object_size;
+        uint32_t id_size;
+        uint32_t metadata_size;
+        uint32_t sub_steps;
+        int32_t  world_width;
+        int32_t  world_height;
+        float    gravity_x;
+        float    gravity_y;
+        uint64_t slots_count;
+        uint64_t objects_count;
+        uint64_t op_count;
+        uint64_t data_offset;
+        uint64_t ids_offset;
+        uint64_t metadata_offset;
+        uint64_t file_size;
+        // Checksum of the header, with this field set to 0, and of everything after it
+        uint64_t checksum;
+    };
+
+    using IdType       = decltype(PhysicSolver::objects.ids)::value_type;
+    using MetadataType = decltype(PhysicSolver::objects.metadata)::value_type;
+
+    static_assert(std::is_trivially_copyable_v<PhysicObject>, "Objects are written as raw memory");
+
+    static bool save(const PhysicSolver& solver, const std::string& path)
+    {
+        const auto& objects = solver.objects;
+        Header header{};
+        header.magic           = magic;
+        header.version         = version;
+        header.object_size     = sizeof(PhysicObject);
+        header.id_size         = sizeof(IdType);
+        header.metadata_size   = sizeof(MetadataType);
+        header.sub_steps       = solver.sub_steps;
+        header.world_width     = solver.grid.width;
+        header.world_height    = solver.grid.height;
+        header.gravity_x       = solver.gravity.x;
+        header.gravity_y       = solver.gravity.y;
+        header.slots_count     = objects.data.size();
+        header.objects_count   = objects.data_size;
+        header.op_count        = objects.op_count;
+        header.data_offset     = align(sizeof(Header));
+        header.ids_offset      = align(header.data_offset + header.slots_count * sizeof(PhysicObject));
+        header.metadata_offset = align(header.ids_offset + header.slots_count * sizeof(IdType));
+        header.file_size       = header.metadata_offset + header.slots_count * sizeof(MetadataType);
+
+        std::vector<uint8_t> payload(header.file_size - sizeof(Header), 0);
+        const auto write_section = [&](uint64_t offset, const void* source, uint64_t size) {
+            if (size) {
+                std::memcpy(payload.data() + offset - sizeof(Header), source, size);
+            }
+        };
+        write_section(header.data_offset, objects.data.data(), header.slots_count * sizeof(PhysicObject));
+        write_section(header.ids_offset, objects.ids.data(), header.slots_count * sizeof(IdType));
+        write_section(header.metadata_offset, objects.metadata.data(), header.slots_count * sizeof(MetadataType));
+        header.checksum = computeChecksum(header, payload.data(), payload.size());
+
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        file.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+        file.write(reinterpret_cast<const char*>(payload.data()), static_cast<std::streamsize>(payload.size()));
+        if (!file) {
+            std::cerr << "Cannot write state file " << path << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    static bool load(PhysicSolver& solver, const std::string& path)
+    {
+        const MappedFile file(path);
+        if (!file.data) {
+            std::cerr << "Cannot open state file " << path << std::endl;
+            return false;
+        }
+        if (file.size < sizeof(Header)) {
+            std::cerr << "State file " << path << " is truncated" << std::endl;
+            return false;
+        }
+        Header header{};
+        std::memcpy(&header, file.data, sizeof(Header));
+        if (header.magic != magic || header.version != version) {
+            std::cerr << "State file " << path << " has an unsupported format or version" << std::endl;
+            return false;
+        }
+        if (header.object_size != sizeof(PhysicObject) || header.id_size != sizeof(IdType) || header.metadata_size != sizeof(MetadataType)) {
+            std::cerr << "State file " << path << " was written by an incompatible build" << std::endl;
+            return false;
+        }
+        if (computeChecksum(header, file.data + sizeof(Header), file.size - sizeof(Header)) != header.checksum) {
+            std::cerr << "State file " << path << " checksum mismatch" << std::endl;
+            return false;
+        }
+        // A checksum can be forged or collide, sections are still checked against the file
+        if (header.file_size != file.size || header.objects_count > header.slots_count ||
+            !isSectionValid(header.data_offset, header.slots_count, sizeof(PhysicObject), file.size) ||
+            !isSectionValid(header.ids_offset, header.slots_count, sizeof(IdType), file.size) ||
+            !isSectionValid(header.metadata_offset, header.slots_count, sizeof(MetadataType), file.size) ||
+            header.sub_steps == 0 || header.world_width <= 0 || header.world_height <= 0 ||
+            to<uint64_t>(header.world_width) * to<uint64_t>(header.world_height) > max_world_cells) {
+            std::cerr << "State file " << path << " is corrupted" << std::endl;
+            return false;
+        }
+        const auto* data_begin     = reinterpret_cast<const PhysicObject*>(file.data + header.data_offset);
+        const auto* ids_begin      = reinterpret_cast<const IdType*>(file.data + header.ids_offset);
+        const auto* metadata_begin = reinterpret_cast<const MetadataType*>(file.data + header.metadata_offset);
+        if (!areIdsValid(ids_begin, metadata_begin, header.slots_count)) {
+            std::cerr << "State file " << path << " has corrupted ids" << std::endl;
+            return false;
+        }
+        // Objects created after such a state would get references aliasing older ones
+        if (header.op_count > decltype(PhysicSolver::objects)::max_index) {
+            std::cerr << "State file " << path << " has objects ids overflowing their index" << std::endl;
+            return false;
+        }
+        // Adopt the mapped sections, this is the only copy
+        auto& objects = solver.objects;
+        objects.data.assign(data_begin, data_begin + header.slots_count);
+        objects.ids.assign(ids_begin, ids_begin + header.slots_count);
+        objects.metadata.assign(metadata_begin, metadata_begin + header.slots_count);
+        objects.data_size = header.objects_count;
+        objects.op_count  = header.op_count;
+        objects.index_overflow = false;
+        solver.index_overflow_reported = false;
+
+        solver.gravity   = {header.gravity_x, header.gravity_y};
+        solver.sub_steps = header.sub_steps;
+        if (header.world_width != solver.grid.width || header.world_height != solver.grid.height) {
+            solver.resize({header.world_width, header.world_height});
+        }
+        // Objects were replaced, the grid and their placement no longer match them
+        solver.grid_outdated   = true;
+        solver.memory_outdated = true;
+        return true;
+    }
+
+private:
+    // Read only view of a whole file, memory mapped when the platform allows it
+    struct MappedFile
+    {
+        const uint8_t*       data = nullptr;
+        uint64_t             size = 0;
+        std::vector<uint8_t> buffer;
+
+        explicit
+        MappedFile(const std::string& path)
+        {
+#ifdef VERLET_STATE_FILE_MMAP
+            const int32_t fd = open(path.c_str(), O_RDONLY);
+            if (fd < 0) {
+                return;
+            }
+            struct stat file_stat{};
+            if (fstat(fd, &file_stat) == 0 && file_stat.st_size > 0) {
+                void* mapping = mmap(nullptr, static_cast<size_t>(file_stat.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+                if (mapping != MAP_FAILED) {
+                    madvise(mapping, static_cast<size_t>(file_stat.st_size), MADV_SEQUENTIAL);
+                    data = static_cast<const uint8_t*>(mapping);
+                    size = static_cast<uint64_t>(file_stat.st_size);
+                }
+            }
+            close(fd);
+#else
+            std::ifstream file(path, std::ios::binary | std::ios::ate);
+            if (!file) {
+                return;
+            }
+            buffer.resize(static_cast<size_t>(file.tellg()));
+            file.seekg(0);
+            file.read(reinterpret_cast<char*>(buffer.data()), static_cast<std::streamsize>(buffer.size()));
+            data = buffer.data();
+            size = buffer.size();
+#endif
+        }
+
+        ~MappedFile()
+        {
+#ifdef VERLET_STATE_FILE_MMAP
+            if (data) {
+                munmap(const_cast<uint8_t*>(data), static_cast<size_t>(size));
+            }
+#endif
+        }
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+    };
+
+    static uint64_t align(uint64_t offset)
+    {
+        return (offset + alignment - 1) / alignment * alignment;
+    }
+
+    // The section lies after the header, inside the file, and is aligned for its type
+    static bool isSectionValid(uint64_t offset, uint64_t count, uint64_t element_size, uint64_t file_size)
+    {
+        return offset >= sizeof(Header) && offset <= file_size && offset % alignment == 0 &&
+               count <= (file_size - offset) / element_size;
+    }
+
+    // Slots ids and their reverse ids must be inverse permutations of [0, slots_count): every object
+    // then has exactly one id, and ids of removed objects, past objects_count, stay free for reuse
+    static bool areIdsValid(const IdType* ids, const MetadataType* metadata, uint64_t slots_count)
+    {
+        for (uint64_t i{0}; i < slots_count; ++i) {
+            if (ids[i] >= slots_count || metadata[i].rid >= slots_count || ids[metadata[i].rid] != i) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    static uint64_t computeChecksum(Header header, const uint8_t* payload, uint64_t size)
+    {
+        header.checksum = 0;
+        const uint64_t hash = computeChecksum(0xcbf29ce484222325ull, reinterpret_cast<const uint8_t*>(&header), sizeof(Header));
+        return computeChecksum(hash, payload, size);
+    }
+
+    // FNV-1a applied on 64 bits words, fast enough to check large files at load time
+    static uint64_t computeChecksum(uint64_t hash, const uint8_t* data, uint64_t size)
+    {
+        constexpr uint64_t prime = 0x100000001b3ull;
+        uint64_t i{0};
+        for (; i + 8 <= size; i += 8) {
+            uint64_t word;
+            std::memcpy(&word, data + i, 8);
+            hash = (hash ^ word) * prime;
+        }
+        for (; i < size; ++i) {
+            hash = (hash ^ data[i]) * prime;
+        }
+        return hash;
+    }
+};
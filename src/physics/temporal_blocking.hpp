@@ -0,0 +1,236 @@
+#pragma once
+#include <algorithm>
+#include "collision_grid.hpp"
+#include "solver_kernels.hpp"
+#include "profiler/profiler.hpp"
+#include "thread_pool/thread_pool.hpp"
+
+
+// Runs several sub steps on a column band of the world before moving to the next one.
+// Each tile works on a private copy of its objects plus a halo that grows with the number
+// of blocked sub steps. Objects at the halo's outer edge miss their outer neighbors, the
+// halo is wide enough for these errors not to reach owned objects during the pass: columns
+// are solved in three passes by global column modulo 3, so a sub step spreads an error by
+// at most two columns per pass, plus the column an object can move by. Objects are added
+// to local grids in global order, owned objects then end up exactly as if the whole world
+// was a single tile. They are read and written back once per pass instead of three times
+// per sub step, which keeps the working set in cache.
+struct TemporalBlocking
+{
+    struct Tile
+    {
+        // Columns owned by the tile
+        int32_t                   begin       = 0;
+        int32_t                   end         = 0;
+        // First column of the local grid
+        int32_t                   origin      = 0;
+        // Owned and halo objects sorted by global id, owned ones are flagged
+        std::vector<PhysicObject> objects;
+        std::vector<uint32_t>     global_ids;
+        std::vector<uint8_t>      owned;
+        CollisionGrid             grid;
+        // Only counts pairs tested from an owned object, as the tile owning the other one counts the reverse test
+        ContactStats              stats;
+        ContactStats              halo_stats;
+        float                     max_speed   = 0.0f;
+    };
+
+    // Sub steps performed on a tile before moving to the next one
+    uint32_t steps_per_pass = 4;
+    // Tile width in cells, the default keeps a dense 300 cells high tile around L2 size
+    int32_t  tile_width     = 32;
+    // Columns added on each side of a tile for each blocked sub step: three column passes
+    // spreading an error by two columns each, and one column of movement
+    int32_t  halo_per_step  = 7;
+
+    std::vector<Tile>                  tiles;
+    // Objects owned by each tile
+    std::vector<std::vector<uint32_t>> buckets;
+
+    void update(PhysicObject* data, uint32_t count, Vec2 world_size, Vec2 gravity, float dt, uint32_t steps, tp::ThreadPool& thread_pool)
+    {
+        initializeTiles(world_size);
+        const int32_t halo = halo_per_step * to<int32_t>(steps) + 1;
+        // Assign each object to the tile owning its column
+        for (std::vector<uint32_t>& bucket : buckets) {
+            bucket.clear();
+        }
+        for (uint32_t i{0}; i < count; ++i) {
+            buckets[getTileIndex(data[i].position.x)].push_back(i);
+        }
+        // Solve tiles on private copies, data is only read during this phase
+        const auto tiles_count = to<uint32_t>(tiles.size());
+        tp::TaskGroup group;
+        for (uint32_t i{0}; i < tiles_count; ++i) {
+            thread_pool.addTask(group, [this, i, halo, steps, dt, world_size, gravity, data]{
+                VERLET_PROFILE_SCOPE(profiler::Phase::Tiles);
+                Tile& tile = tiles[i];
+                gatherTile(tile, i, data, halo);
+                for (uint32_t k{steps}; k--;) {
+                    solveTileStep(tile, world_size, gravity, dt);
+                }
+            });
+        }
+        group.wait();
+        // Write back owned objects, each object is owned by exactly one tile
+        for (uint32_t i{0}; i < tiles_count; ++i) {
+            thread_pool.addTask(group, [this, i, data]{
+                VERLET_PROFILE_SCOPE(profiler::Phase::Tiles);
+                const Tile& tile = tiles[i];
+                const auto objects_count = to<uint32_t>(tile.objects.size());
+                for (uint32_t k{0}; k < objects_count; ++k) {
+                    if (tile.owned[k]) {
+                        data[tile.global_ids[k]] = tile.objects[k];
+                    }
+                }
+            });
+        }
+        group.wait();
+    }
+
+    void resetStats()
+    {
+        for (Tile& tile : tiles) {
+            tile.stats.reset();
+            tile.halo_stats.reset();
+            tile.max_speed = 0.0f;
+        }
+    }
+
+    [[nodiscard]]
+    ContactStats getStats() const
+    {
+        ContactStats result;
+        for (const Tile& tile : tiles) {
+            result.add(tile.stats);
+        }
+        return result;
+    }
+
+    [[nodiscard]]
+    float getMaxSpeed() const
+    {
+        float result = 0.0f;
+        for (const Tile& tile : tiles) {
+            result = std::max(result, tile.max_speed);
+        }
+        return std::sqrt(result);
+    }
+
+private:
+    void initializeTiles(Vec2 world_size)
+    {
+        const auto    world_width = to<int32_t>(world_size.x);
+        const int32_t max_halo    = halo_per_step * to<int32_t>(steps_per_pass) + 1;
+        const int32_t tiles_count = (world_width + tile_width - 1) / tile_width;
+        // Local grids are sized for the largest halo, they are reused across passes
+        const int32_t grid_width  = tile_width + 2 * max_halo + 2;
+        if (to<int32_t>(tiles.size()) == tiles_count && tiles.front().grid.width == grid_width) {
+            return;
+        }
+        tiles.resize(tiles_count);
+        buckets.resize(tiles_count);
+        for (int32_t i{0}; i < tiles_count; ++i) {
+            Tile& tile  = tiles[i];
+            tile.begin  = i * tile_width;
+            tile.end    = std::min(tile.begin + tile_width, world_width);
+            tile.origin = tile.begin - max_halo - 1;
+            tile.grid   = CollisionGrid(grid_width, to<int32_t>(world_size.y));
+        }
+    }
+
+    [[nodiscard]]
+    uint32_t getTileIndex(float x) const
+    {
+        const int32_t index = to<int32_t>(x) / tile_width;
+        return to<uint32_t>(std::min(std::max(index, 0), to<int32_t>(tiles.size()) - 1));
+    }
+
+    void gatherTile(Tile& tile, uint32_t tile_index, const PhysicObject* data, int32_t halo)
+    {
+        tile.global_ids.clear();
+        // Halo objects come from the neighbor tiles covering the halo columns
+        const auto first = to<float>(tile.begin - halo);
+        const auto last  = to<float>(tile.end + halo);
+        const uint32_t first_tile = getTileIndex(first);
+        const uint32_t last_tile  = getTileIndex(last);
+        for (uint32_t t{first_tile}; t <= last_tile; ++t) {
+            for (const uint32_t id : buckets[t]) {
+                const float x = data[id].position.x;
+                if (t == tile_index || (x >= first && x < last)) {
+                    tile.global_ids.push_back(id);
+                }
+            }
+        }
+        // Same order as in any other tile, contacts of owned objects are then solved identically
+        std::sort(tile.global_ids.begin(), tile.global_ids.end());
+        tile.objects.clear();
+        tile.owned.clear();
+        for (const uint32_t id : tile.global_ids) {
+            tile.objects.push_back(data[id]);
+            tile.owned.push_back(getTileIndex(data[id].position.x) == tile_index);
+        }
+    }
+
+    static void solveTileStep(Tile& tile, Vec2 world_size, Vec2 gravity, float dt)
+    {
+        CollisionGrid& grid = tile.grid;
+        grid.clear();
+        const auto objects_count = to<uint32_t>(tile.objects.size());
+        for (uint32_t i{0}; i < objects_count; ++i) {
+            const Vec2 position = tile.objects[i].position;
+            const int32_t x = to<int32_t>(position.x) - tile.origin;
+            ContactStats& stats = tile.owned[i] ? tile.stats : tile.halo_stats;
+            // Objects that left the local grid are not colliding anymore, they are part of the outer halo
+            if (!SolverKernels::isInGrid(position, world_size)) {
+                ++stats.border_skips;
+            } else if (x > 0 && x < grid.width - 1) {
+                stats.cell_overflows += !grid.addAtom(x, to<int32_t>(position.y), i);
+            }
+        }
+        // Columns of a pass are three apart, they do not share objects and their order does not matter
+        for (int32_t pass{0}; pass < 3; ++pass) {
+            const int32_t first_column = 1 + ((pass - 1 - tile.origin) % 3 + 3) % 3;
+            for (int32_t x{first_column}; x < grid.width - 1; x += 3) {
+                const auto column_start = to<uint32_t>(x * grid.height);
+                for (int32_t y{0}; y < grid.height; ++y) {
+                    processCell(tile, column_start + y);
+                }
+            }
+        }
+        float max_speed = tile.max_speed;
+        for (uint32_t i{0}; i < objects_count; ++i) {
+            const float displacement2 = SolverKernels::integrate(tile.objects[i], gravity, world_size, dt);
+            if (tile.owned[i]) {
+                max_speed = std::max(max_speed, displacement2);
+            }
+        }
+        tile.max_speed = max_speed;
+    }
+
+    static void checkAtomCellCollisions(Tile& tile, uint32_t atom_idx, const CollisionCell& c)
+    {
+        ContactStats& stats = tile.owned[atom_idx] ? tile.stats : tile.halo_stats;
+        for (uint32_t i{0}; i < c.objects_count; ++i) {
+            SolverKernels::solveContact(tile.objects[atom_idx], tile.objects[c.objects[i]], stats);
+        }
+    }
+
+    static void processCell(Tile& tile, uint32_t index)
+    {
+        const CollisionGrid& grid = tile.grid;
+        const CollisionCell& c    = grid.data[index];
+        for (uint32_t i{0}; i < c.objects_count; ++i) {
+            const uint32_t atom_idx = c.objects[i];
+            checkAtomCellCollisions(tile, atom_idx, grid.data[index - 1]);
+            checkAtomCellCollisions(tile, atom_idx, grid.data[index]);
+            checkAtomCellCollisions(tile, atom_idx, grid.data[index + 1]);
+            checkAtomCellCollisions(tile, atom_idx, grid.data[index + grid.height - 1]);
+            checkAtomCellCollisions(tile, atom_idx, grid.data[index + grid.height    ]);
+            checkAtomCellCollisions(tile, atom_idx, grid.data[index + grid.height + 1]);
+            checkAtomCellCollisions(tile, atom_idx, grid.data[index - grid.height - 1]);
+            checkAtomCellCollisions(tile, atom_idx, grid.data[index - grid.height    ]);
+            checkAtomCellCollisions(tile, atom_idx, grid.data[index - grid.height + 1]);
+        }
+    }
+};
@@ -0,0 +1,225 @@
+#pragma once
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "scaling_report.hpp"
+#include "engine/common/racc.hpp"
+#include "physics/physics.hpp"
+
+#if defined(__APPLE__)
+    #include <sys/sysctl.h>
+#endif
+
+
+// Parallel layout of the solver, the defaults are the ones used without tuning
+struct TuningConfig
+{
+    uint32_t   threads_count              = 10;
+    uint32_t   collision_tasks_per_thread = 1;
+    UpdateMode mode                       = UpdateMode::Barrier;
+    // Only used by the temporal blocking mode
+    int32_t    tile_width                 = 32;
+    uint32_t   steps_per_pass             = 4;
+
+    // The solver's thread pool has to be created with threads_count threads
+    void apply(PhysicSolver& solver) const
+    {
+        solver.mode = mode;
+        solver.setCollisionTasksPerThread(collision_tasks_per_thread);
+        solver.temporal_blocking.tile_width     = tile_width;
+        solver.temporal_blocking.steps_per_pass = steps_per_pass;
+    }
+};
+
+
+// Times short solver trials on a dense settled scene to pick the thread count, the collision
+// stripes granularity and the update mode with its tiling. The search is done one parameter at
+// a time, a candidate replaces the current best only if clearly faster so that noise does not
+// flip configurations. Results are cached per CPU model and hardware threads count.
+struct AutoTuner
+{
+    IVec2    world_size       = {200, 200};
+    // Close to the main scene once the emitter is done
+    float    density          = 0.8f;
+    uint32_t warmup_updates   = 20;
+    uint32_t measured_updates = 30;
+    float    dt               = 1.0f / 60.0f;
+    // Minimum speedup for a candidate to replace the current best
+    float    min_gain         = 1.03f;
+
+    // Cached configuration of this machine, calibrated and saved first if missing or if forced
+    TuningConfig getConfig(const std::string& cache_path, bool force_calibration) const
+    {
+        const std::string key = getMachineKey();
+        TuningConfig config;
+        if (!force_calibration && load(cache_path, key, config)) {
+            std::cout << "Tuning loaded from " << cache_path << " for " << key << std::endl;
+            return config;
+        }
+        std::cout << "Calibrating for " << key << std::endl;
+        config = calibrate();
+        if (save(cache_path, key, config)) {
+            std::cout << "Tuning saved to " << cache_path << std::endl;
+        }
+        return config;
+    }
+
+    [[nodiscard]]
+    TuningConfig calibrate() const
+    {
+        const uint32_t hardware_threads = std::max(1u, std::thread::hardware_concurrency());
+        TuningConfig best;
+        best.threads_count = 1;
+        float best_throughput = measure(best);
+
+        const auto consider = [&](const TuningConfig& candidate) {
+            const float throughput = measure(candidate);
+            if (throughput > best_throughput * min_gain) {
+                best            = candidate;
+                best_throughput = throughput;
+            }
+        };
+        // Oversubscription is tried as well, workers yield when idle
+        for (uint32_t count{2}; count <= 2 * hardware_threads; count *= 2) {
+            TuningConfig candidate = best;
+            candidate.threads_count = count;
+            consider(candidate);
+        }
+        for (const UpdateMode mode : {UpdateMode::Barrier, UpdateMode::TaskGraph}) {
+            for (const uint32_t tasks : {1u, 2u, 4u}) {
+                TuningConfig candidate = best;
+                candidate.mode                       = mode;
+                candidate.collision_tasks_per_thread = tasks;
+                consider(candidate);
+            }
+        }
+        for (const int32_t tile_width : {16, 32, 64}) {
+            for (const uint32_t steps : {2u, 4u, 8u}) {
+                TuningConfig candidate = best;
+                candidate.mode           = UpdateMode::TemporalBlocking;
+                candidate.tile_width     = tile_width;
+                candidate.steps_per_pass = steps;
+                consider(candidate);
+            }
+        }
+        std::printf("Selected: ");
+        print(best, best_throughput);
+        return best;
+    }
+
+    // Objects updated per millisecond, from the median update time
+    [[nodiscard]]
+    float measure(const TuningConfig& config) const
+    {
+        tp::ThreadPool thread_pool{config.threads_count};
+        PhysicSolver   solver{world_size, thread_pool};
+        config.apply(solver);
+        ScalingReport::fill(solver, density);
+        for (uint32_t i{warmup_updates}; i--;) {
+            solver.update(dt);
+        }
+        RQuantile<float> update_ms;
+        for (uint32_t i{measured_updates}; i--;) {
+            const auto start = std::chrono::steady_clock::now();
+            solver.update(dt);
+            const std::chrono::duration<float, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+            update_ms.addValue(elapsed.count());
+        }
+        const float throughput = to<float>(solver.objects.size()) / std::max(update_ms.get(0.5), 1e-3f);
+        print(config, throughput);
+        return throughput;
+    }
+
+    static void print(const TuningConfig& config, float throughput)
+    {
+        const char* names[] = {"barrier", "temporal blocking", "task graph"};
+        std::printf("%2u threads  %-17s  %u tasks/thread  tiles %2d x %u steps  %9.0f objects/ms\n",
+                    config.threads_count, names[static_cast<uint32_t>(config.mode)], config.collision_tasks_per_thread,
+                    config.tile_width, config.steps_per_pass, throughput);
+    }
+
+    // CPU model and hardware threads count, configurations are not portable between machines
+    static std::string getMachineKey()
+    {
+        std::string model;
+#if defined(__linux__)
+        std::ifstream cpu_info{"/proc/cpuinfo"};
+        std::string   line;
+        while (model.empty() && std::getline(cpu_info, line)) {
+            // x86 reports a model name, some ARM kernels only a hardware name
+            if (line.rfind("model name", 0) == 0 || line.rfind("Hardware", 0) == 0) {
+                const auto separator = line.find(':');
+                if (separator != std::string::npos && separator + 2 <= line.size()) {
+                    model = line.substr(separator + 2);
+                }
+            }
+        }
+#elif defined(__APPLE__)
+        char   brand[256] = {};
+        size_t size       = sizeof(brand);
+        if (sysctlbyname("machdep.cpu.brand_string", brand, &size, nullptr, 0) == 0) {
+            model = brand;
+        }
+#endif
+        if (model.empty()) {
+            model = "unknown";
+        }
+        return model + " x" + toString(std::max(1u, std::thread::hardware_concurrency()));
+    }
+
+    // One line per machine: key, tab, then the configuration's fields
+    static bool load(const std::string& path, const std::string& key, TuningConfig& config)
+    {
+        std::ifstream file{path};
+        std::string   line;
+        while (std::getline(file, line)) {
+            if (line.rfind(key + '\t', 0) != 0) {
+                continue;
+            }
+            std::istringstream values{line.substr(key.size() + 1)};
+            TuningConfig loaded;
+            uint32_t     mode = 0;
+            if (values >> loaded.threads_count >> loaded.collision_tasks_per_thread >> mode >> loaded.tile_width >> loaded.steps_per_pass &&
+                loaded.threads_count && mode <= static_cast<uint32_t>(UpdateMode::TaskGraph) && loaded.tile_width > 0 && loaded.steps_per_pass) {
+                loaded.mode = static_cast<UpdateMode>(mode);
+                config = loaded;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Entries of other machines are kept
+    static bool save(const std::string& path, const std::string& key, const TuningConfig& config)
+    {
+        std::vector<std::string> lines;
+        {
+            std::ifstream file{path};
+            std::string   line;
+            while (std::getline(file, line)) {
+                if (line.rfind(key + '\t', 0) != 0) {
+                    lines.push_back(line);
+                }
+            }
+        }
+        std::ostringstream entry;
+        entry << key << '\t' << config.threads_count << ' ' << config.collision_tasks_per_thread << ' '
+              << static_cast<uint32_t>(config.mode) << ' ' << config.tile_width << ' ' << config.steps_per_pass;
+        lines.push_back(entry.str());
+
+        std::ofstream file{path, std::ios::trunc};
+        for (const std::string& line : lines) {
+            file << line << '\n';
+        }
+        if (!file) {
+            std::cerr << "Cannot write tuning cache " << path << std::endl;
+            return false;
+        }
+        return true;
+    }
+};
@@ -0,0 +1,188 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__linux__)
+    #include <linux/perf_event.h>
+    #include <sys/ioctl.h>
+    #include <sys/syscall.h>
+    #include <unistd.h>
+    #define VERLET_PERF_COUNTERS 1
+#endif
+
+
+namespace profiler
+{
+
+enum class Counter : uint8_t
+{
+    Cycles,
+    Instructions,
+    CacheMisses,
+    BranchMisses,
+    Count,
+};
+
+constexpr auto counters_count = static_cast<uint32_t>(Counter::Count);
+
+struct CounterValues
+{
+    std::array<uint64_t, counters_count> values{};
+
+    uint64_t get(Counter counter) const
+    {
+        return values[static_cast<uint32_t>(counter)];
+    }
+
+    [[nodiscard]]
+    float getIPC() const
+    {
+        const uint64_t cycles = get(Counter::Cycles);
+        return cycles ? static_cast<float>(get(Counter::Instructions)) / static_cast<float>(cycles) : 0.0f;
+    }
+
+    CounterValues operator-(const CounterValues& other) const
+    {
+        CounterValues result;
+        for (uint32_t i{0}; i < counters_count; ++i) {
+            result.values[i] = values[i] - other.values[i];
+        }
+        return result;
+    }
+
+    CounterValues& operator+=(const CounterValues& other)
+    {
+        for (uint32_t i{0}; i < counters_count; ++i) {
+            values[i] += other.values[i];
+        }
+        return *this;
+    }
+};
+
+
+// Hardware counters of the calling thread, user space only. With inherit, threads created after
+// open() are counted too, which covers a thread pool created afterwards. Counters are grouped so
+// that they are scheduled together on the PMU and a single read returns all of them; older
+// kernels reject groups of inherited counters, these are then opened and read one by one.
+// Opening fails when the platform, the kernel's perf_event_paranoid setting or a container
+// forbids it, values then stay at 0.
+class PerfCounters
+{
+public:
+    PerfCounters() = default;
+
+    ~PerfCounters()
+    {
+        close();
+    }
+
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+
+    bool open(bool inherit = false)
+    {
+#ifdef VERLET_PERF_COUNTERS
+        close();
+        m_grouped = openCounters(inherit, true);
+        return m_grouped || (inherit && openCounters(inherit, false));
+#else
+        static_cast<void>(inherit);
+        return false;
+#endif
+    }
+
+    void close()
+    {
+#ifdef VERLET_PERF_COUNTERS
+        for (int32_t& fd : m_fds) {
+            if (fd >= 0) {
+                ::close(fd);
+                fd = -1;
+            }
+        }
+#endif
+    }
+
+    [[nodiscard]]
+    bool isOpen() const
+    {
+        return m_fds[0] >= 0;
+    }
+
+    // Counts since open(), a single read when grouped
+    [[nodiscard]]
+    CounterValues read() const
+    {
+        CounterValues result;
+#ifdef VERLET_PERF_COUNTERS
+        if (!isOpen()) {
+            return result;
+        }
+        if (m_grouped) {
+            // Counters count, time enabled, time running, then the values in opening order
+            std::array<uint64_t, 3 + counters_count> data{};
+            if (::read(m_fds[0], data.data(), sizeof(data)) == static_cast<ssize_t>(sizeof(data)) && data[0] == counters_count) {
+                for (uint32_t i{0}; i < counters_count; ++i) {
+                    result.values[i] = scale(data[3 + i], data[1], data[2]);
+                }
+            }
+            return result;
+        }
+        for (uint32_t i{0}; i < counters_count; ++i) {
+            // Value, time enabled, time running
+            std::array<uint64_t, 3> data{};
+            if (::read(m_fds[i], data.data(), sizeof(data)) == static_cast<ssize_t>(sizeof(data))) {
+                result.values[i] = scale(data[0], data[1], data[2]);
+            }
+        }
+#endif
+        return result;
+    }
+
+private:
+    std::array<int32_t, counters_count> m_fds = {-1, -1, -1, -1};
+    bool                                m_grouped = false;
+
+#ifdef VERLET_PERF_COUNTERS
+    bool openCounters(bool inherit, bool grouped)
+    {
+        constexpr std::array<uint64_t, counters_count> configs = {
+            PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES
+        };
+        for (uint32_t i{0}; i < counters_count; ++i) {
+            perf_event_attr attr;
+            std::memset(&attr, 0, sizeof(attr));
+            attr.size           = sizeof(attr);
+            attr.type           = PERF_TYPE_HARDWARE;
+            attr.config         = configs[i];
+            attr.exclude_kernel = 1;
+            attr.exclude_hv     = 1;
+            attr.inherit        = inherit;
+            // Multiplexed counters are scaled by the time they actually ran
+            attr.read_format    = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+            if (grouped) {
+                attr.read_format |= PERF_FORMAT_GROUP;
+            }
+            const int32_t group = (grouped && i > 0) ? m_fds[0] : -1;
+            m_fds[i] = static_cast<int32_t>(syscall(SYS_perf_event_open, &attr, 0, -1, group, 0));
+            if (m_fds[i] < 0) {
+                close();
+                return false;
+            }
+        }
+        return true;
+    }
+#endif
+
+    // Value extrapolated to the whole time the counter was enabled, 0 if it never ran
+    static uint64_t scale(uint64_t value, uint64_t enabled, uint64_t running)
+    {
+        if (!running) {
+            return 0;
+        }
+        return enabled == running ? value : static_cast<uint64_t>(static_cast<double>(value) * static_cast<double>(enabled) / static_cast<double>(running));
+    }
+};
+
+}
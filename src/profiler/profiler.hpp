@@ -0,0 +1,331 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <vector>
+#include "perf_counters.hpp"
+#include "engine/common/racc.hpp"
+
+
+// Records the enclosing scope as the given profiler::Phase. Scopes are only recorded
+// when VERLET_PROFILING is defined, otherwise they compile to nothing.
+#ifdef VERLET_PROFILING
+    #define VERLET_PROFILE_CONCAT_(a, b) a##b
+    #define VERLET_PROFILE_CONCAT(a, b)  VERLET_PROFILE_CONCAT_(a, b)
+    #define VERLET_PROFILE_SCOPE(phase)  const profiler::Scope VERLET_PROFILE_CONCAT(profile_scope_, __LINE__){phase}
+#else
+    #define VERLET_PROFILE_SCOPE(phase)  static_cast<void>(0)
+#endif
+
+
+namespace profiler
+{
+
+enum class Phase : uint8_t
+{
+    Emission,
+    Grid,
+    CollisionPass1,
+    CollisionPass2,
+    Integration,
+    Tiles,
+    VertexArray,
+    Draw,
+    // Encloses the phases of the solver, only used for its distribution
+    SubStep,
+    Count,
+};
+
+constexpr auto phases_count = static_cast<uint32_t>(Phase::Count);
+
+inline const char* getName(Phase phase)
+{
+    constexpr std::array<const char*, phases_count> names = {
+        "emission", "grid", "collision pass 1", "collision pass 2", "integration", "tiles", "vertex array", "draw", "sub step"
+    };
+    return names[static_cast<uint32_t>(phase)];
+}
+
+struct Event
+{
+    Phase         phase;
+    // Nanoseconds since the profiler's creation
+    uint64_t      start;
+    uint64_t      end;
+    // Hardware counters of the scope, zero unless enabled and available
+    CounterValues counters;
+};
+
+// Events of one thread. Only this thread writes, the collector follows the write counter and
+// drops events that were overwritten while it was reading them.
+struct ThreadTimeline
+{
+    static constexpr uint32_t capacity = 4096;
+
+    std::array<Event, capacity> events;
+    std::atomic<uint64_t>       written = 0;
+    // Collector side
+    uint64_t                    read    = 0;
+    // Opened on the owning thread the first time counters are enabled
+    PerfCounters                 counters;
+    bool                         counters_opened = false;
+
+    void push(const Event& event)
+    {
+        const uint64_t index = written.load(std::memory_order_relaxed);
+        events[index % capacity] = event;
+        written.store(index + 1, std::memory_order_release);
+    }
+};
+
+
+class Profiler
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    static Profiler& get()
+    {
+        static Profiler profiler;
+        return profiler;
+    }
+
+    // The calling thread's timeline, created on its first event
+    ThreadTimeline& getTimeline()
+    {
+        thread_local ThreadTimeline* timeline = registerThread();
+        return *timeline;
+    }
+
+    // Scopes also read hardware counters, each thread opens its own group on its next scope
+    void setHardwareCounters(bool enabled)
+    {
+        m_counters_enabled = enabled;
+    }
+
+    // Counters of the calling thread, nullptr when disabled or unavailable
+    const PerfCounters* getCounters(ThreadTimeline& timeline)
+    {
+        if (!m_counters_enabled.load(std::memory_order_relaxed)) {
+            return nullptr;
+        }
+        if (!timeline.counters_opened) {
+            timeline.counters_opened = true;
+            if (timeline.counters.open()) {
+                m_counters_available = true;
+            }
+        }
+        return timeline.counters.isOpen() ? &timeline.counters : nullptr;
+    }
+
+    [[nodiscard]]
+    uint64_t now() const
+    {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - m_epoch).count());
+    }
+
+    // Gathers the events recorded since the last call and feeds the phases' rolling means
+    void collect()
+    {
+        std::lock_guard<std::mutex> lock{m_mutex};
+        const uint64_t collect_time = now();
+        std::array<uint64_t, phases_count> durations{};
+        m_frame_events.resize(m_timelines.size());
+        for (uint32_t t{0}; t < m_timelines.size(); ++t) {
+            ThreadTimeline& timeline = *m_timelines[t];
+            std::vector<Event>& events = m_frame_events[t];
+            events.clear();
+            const uint64_t written = timeline.written.load(std::memory_order_acquire);
+            const uint64_t first   = std::max(timeline.read, written - std::min<uint64_t>(written, ThreadTimeline::capacity));
+            for (uint64_t i{first}; i < written; ++i) {
+                events.push_back(timeline.events[i % ThreadTimeline::capacity]);
+            }
+            // Events overwritten during the copy are not reliable
+            const uint64_t written_after = timeline.written.load(std::memory_order_acquire);
+            const uint64_t valid_from    = written_after - std::min<uint64_t>(written_after, ThreadTimeline::capacity);
+            if (valid_from > first) {
+                const uint64_t dropped = std::min<uint64_t>(valid_from - first, events.size());
+                events.erase(events.begin(), events.begin() + static_cast<std::ptrdiff_t>(dropped));
+            }
+            timeline.read = written;
+            for (const Event& event : events) {
+                const uint64_t duration = event.end - event.start;
+                durations[static_cast<uint32_t>(event.phase)] += duration;
+                m_counters[static_cast<uint32_t>(event.phase)] += event.counters;
+                m_durations[static_cast<uint32_t>(event.phase)].addValue(static_cast<float>(duration) * 1e-6f);
+            }
+        }
+        for (uint32_t p{0}; p < phases_count; ++p) {
+            m_means[p].addValue(static_cast<float>(durations[p]) * 1e-6f);
+        }
+        if (m_frame_end) {
+            m_frame_durations.addValue(static_cast<float>(collect_time - m_frame_end) * 1e-6f);
+        }
+        m_frame_start = m_frame_end;
+        m_frame_end   = collect_time;
+        m_collections_count.fetch_add(1, std::memory_order_release);
+    }
+
+    // Incremented by each collection, phase distributions only change when it does
+    [[nodiscard]]
+    uint64_t getCollectionsCount() const
+    {
+        return m_collections_count.load(std::memory_order_acquire);
+    }
+
+    // Duration in milliseconds under which lies the given fraction of the phase's scopes, all threads merged
+    [[nodiscard]]
+    float getQuantile(Phase phase, double quantile)
+    {
+        std::lock_guard<std::mutex> lock{m_mutex};
+        return m_durations[static_cast<uint32_t>(phase)].get(quantile);
+    }
+
+    // Same for all phases and several quantiles at once, under a single lock
+    template<size_t N>
+    void getQuantiles(const std::array<double, N>& quantiles, std::array<std::array<float, N>, phases_count>& result)
+    {
+        std::lock_guard<std::mutex> lock{m_mutex};
+        for (uint32_t p{0}; p < phases_count; ++p) {
+            for (uint32_t q{0}; q < N; ++q) {
+                result[p][q] = m_durations[p].get(quantiles[q]);
+            }
+        }
+    }
+
+    // Same for the time between two collections, that is the frame time
+    [[nodiscard]]
+    float getFrameQuantile(double quantile) const
+    {
+        return m_frame_durations.get(quantile);
+    }
+
+    // Rolling mean of the time spent in a phase per collection, summed over all threads
+    [[nodiscard]]
+    float getMeanMs(Phase phase) const
+    {
+        // The running sum drifts slightly below zero once a phase stops being used
+        return std::max(0.0f, m_means[static_cast<uint32_t>(phase)].get());
+    }
+
+    // Events of each thread between the two last collections
+    [[nodiscard]]
+    const std::vector<std::vector<Event>>& getFrameEvents() const
+    {
+        return m_frame_events;
+    }
+
+    [[nodiscard]]
+    uint64_t getFrameStart() const
+    {
+        return m_frame_start;
+    }
+
+    [[nodiscard]]
+    uint64_t getFrameEnd() const
+    {
+        return m_frame_end;
+    }
+
+    void print(std::ostream& stream)
+    {
+        // Collections update the means, distributions and counters read below
+        std::lock_guard<std::mutex> lock{m_mutex};
+        stream << "Mean CPU time per frame" << std::endl;
+        for (uint32_t p{0}; p < phases_count; ++p) {
+            stream << "  " << getName(static_cast<Phase>(p)) << ": " << getMeanMs(static_cast<Phase>(p)) << " ms" << std::endl;
+        }
+        const std::array<double, 3> quantiles = {0.5, 0.99, 0.999};
+        stream << "Scope duration p50 / p99 / p99.9" << std::endl;
+        for (uint32_t p{0}; p < phases_count; ++p) {
+            stream << "  " << getName(static_cast<Phase>(p)) << ":";
+            for (const double q : quantiles) {
+                stream << " " << m_durations[p].get(q);
+            }
+            stream << " ms" << std::endl;
+        }
+        stream << "  frame:";
+        for (const double q : quantiles) {
+            stream << " " << getFrameQuantile(q);
+        }
+        stream << " ms (" << m_frame_durations.getCount() << " frames)" << std::endl;
+        if (!m_counters_enabled) {
+            return;
+        }
+        if (!m_counters_available) {
+            stream << "Hardware counters are not available" << std::endl;
+            return;
+        }
+        stream << "Hardware counters since start: IPC, cache misses, branch misses" << std::endl;
+        for (uint32_t p{0}; p < phases_count; ++p) {
+            const CounterValues& counters = m_counters[p];
+            stream << "  " << getName(static_cast<Phase>(p)) << ": " << counters.getIPC() << " "
+                   << counters.get(Counter::CacheMisses) << " " << counters.get(Counter::BranchMisses) << std::endl;
+        }
+    }
+
+private:
+    Clock::time_point                            m_epoch = Clock::now();
+    std::mutex                                   m_mutex;
+    std::vector<std::unique_ptr<ThreadTimeline>> m_timelines;
+    std::vector<std::vector<Event>>              m_frame_events;
+    std::vector<RMean<float>>                    m_means = std::vector<RMean<float>>(phases_count, RMean<float>(60));
+    RQuantile<float>                             m_frame_durations;
+    // Durations of the phases' scopes in milliseconds, all threads
+    std::array<RQuantile<float>, phases_count>   m_durations;
+    std::atomic<uint64_t>                        m_collections_count  = 0;
+    std::atomic<bool>                            m_counters_enabled   = false;
+    std::atomic<bool>                            m_counters_available = false;
+    std::array<CounterValues, phases_count>      m_counters;
+    uint64_t                                     m_frame_start = 0;
+    uint64_t                                     m_frame_end   = 0;
+
+    Profiler() = default;
+
+    ThreadTimeline* registerThread()
+    {
+        std::lock_guard<std::mutex> lock{m_mutex};
+        m_timelines.push_back(std::make_unique<ThreadTimeline>());
+        return m_timelines.back().get();
+    }
+};
+
+
+class Scope
+{
+public:
+    explicit
+    Scope(Phase phase)
+        : m_timeline{Profiler::get().getTimeline()}
+        , m_counters{Profiler::get().getCounters(m_timeline)}
+        , m_phase{phase}
+    {
+        if (m_counters) {
+            m_start_counters = m_counters->read();
+        }
+        m_start = Profiler::get().now();
+    }
+
+    ~Scope()
+    {
+        const uint64_t end = Profiler::get().now();
+        m_timeline.push({m_phase, m_start, end, m_counters ? m_counters->read() - m_start_counters : CounterValues{}});
+    }
+
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+
+private:
+    ThreadTimeline&     m_timeline;
+    const PerfCounters* m_counters;
+    Phase               m_phase;
+    uint64_t            m_start = 0;
+    CounterValues       m_start_counters;
+};
+
+}
@@ -0,0 +1,183 @@
+#pragma once
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "perf_counters.hpp"
+#include "engine/common/racc.hpp"
+#include "physics/physics.hpp"
+
+
+// Headless sweep of thread counts and world densities. Each configuration packs objects on a
+// lattice, lets them settle then measures updates. Hardware counters cover the whole process,
+// worker threads included, and are reported per object and update when available. The solver's
+// health over the measured updates relates timing changes to changes of the work done.
+struct ScalingReport
+{
+    struct Row
+    {
+        uint32_t     threads_count            = 0;
+        float        density                  = 0.0f;
+        uint32_t     objects_count            = 0;
+        float        mean_ms                  = 0.0f;
+        float        p99_ms                   = 0.0f;
+        float        speedup                  = 0.0f;
+        bool         counters_available       = false;
+        double       ipc                      = 0.0;
+        double       cache_misses_per_object  = 0.0;
+        double       branch_misses_per_object = 0.0;
+        // Summed over the measured updates, max_penetration is the deepest of all of them
+        SolverHealth health;
+    };
+
+    IVec2                 world_size       = {300, 300};
+    // Fraction of the world's cells holding an object at start
+    std::vector<float>    densities        = {0.2f, 0.4f, 0.6f};
+    std::vector<uint32_t> threads_counts;
+    uint32_t              warmup_updates   = 30;
+    uint32_t              measured_updates = 120;
+    float                 dt               = 1.0f / 60.0f;
+    // Rows are also written there as JSON if not empty
+    std::string           json_path;
+
+    ScalingReport()
+    {
+        const uint32_t hardware_threads = std::max(1u, std::thread::hardware_concurrency());
+        for (uint32_t count{1}; count < hardware_threads; count *= 2) {
+            threads_counts.push_back(count);
+        }
+        threads_counts.push_back(hardware_threads);
+    }
+
+    int32_t run() const
+    {
+        std::printf("threads  objects  mean_ms  p99_ms  speedup    ipc  cache_miss/obj  branch_miss/obj"
+                    "  tested/obj  resolved/obj  max_overlap  overflows  border_skips\n");
+        std::vector<Row> rows;
+        for (const float density : densities) {
+            float reference_ms = 0.0f;
+            for (const uint32_t threads_count : threads_counts) {
+                const Row row = measure(threads_count, density, reference_ms);
+                if (threads_count == threads_counts.front()) {
+                    reference_ms = row.mean_ms;
+                }
+                print(row);
+                rows.push_back(row);
+            }
+        }
+        if (!json_path.empty() && !writeJson(rows)) {
+            return 1;
+        }
+        return 0;
+    }
+
+    Row measure(uint32_t threads_count, float density, float reference_ms) const
+    {
+        // Opened before the pool so that its threads inherit the counters
+        profiler::PerfCounters counters;
+        const bool counters_available = counters.open(true);
+        tp::ThreadPool thread_pool{threads_count};
+        PhysicSolver   solver{world_size, thread_pool};
+        fill(solver, density);
+        for (uint32_t i{warmup_updates}; i--;) {
+            solver.update(dt);
+        }
+
+        Row row;
+        RQuantile<float> update_ms;
+        RMean<float>     mean_ms(measured_updates);
+        const profiler::CounterValues counters_start = counters.read();
+        for (uint32_t i{measured_updates}; i--;) {
+            const auto start = std::chrono::steady_clock::now();
+            solver.update(dt);
+            const std::chrono::duration<float, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+            update_ms.addValue(elapsed.count());
+            mean_ms.addValue(elapsed.count());
+            row.health.candidates_tested += solver.health.candidates_tested;
+            row.health.contacts_resolved += solver.health.contacts_resolved;
+            row.health.cell_overflows    += solver.health.cell_overflows;
+            row.health.border_skips      += solver.health.border_skips;
+            row.health.max_penetration    = std::max(row.health.max_penetration, solver.health.max_penetration);
+        }
+        const profiler::CounterValues measured = counters.read() - counters_start;
+
+        const auto samples = static_cast<double>(solver.objects.size()) * measured_updates;
+        row.threads_count      = threads_count;
+        row.density            = density;
+        row.objects_count      = static_cast<uint32_t>(solver.objects.size());
+        row.mean_ms            = mean_ms.get();
+        row.p99_ms             = update_ms.get(0.99);
+        // The first thread count is its own reference
+        row.speedup            = (reference_ms > 0.0f ? reference_ms : row.mean_ms) / row.mean_ms;
+        row.counters_available = counters_available;
+        if (counters_available) {
+            row.ipc                      = measured.getIPC();
+            row.cache_misses_per_object  = static_cast<double>(measured.get(profiler::Counter::CacheMisses)) / samples;
+            row.branch_misses_per_object = static_cast<double>(measured.get(profiler::Counter::BranchMisses)) / samples;
+        }
+        return row;
+    }
+
+    void print(const Row& row) const
+    {
+        std::printf("%7u  %7u  %7.2f  %6.2f  %7.2f", row.threads_count, row.objects_count, row.mean_ms, row.p99_ms, row.speedup);
+        if (row.counters_available) {
+            std::printf("  %5.2f  %14.2f  %15.2f", row.ipc, row.cache_misses_per_object, row.branch_misses_per_object);
+        } else {
+            std::printf("  %5s  %14s  %15s", "n/a", "n/a", "n/a");
+        }
+        const auto samples = static_cast<double>(row.objects_count) * measured_updates;
+        std::printf("  %10.2f  %12.2f  %11.3f  %9llu  %12llu\n",
+                    static_cast<double>(row.health.candidates_tested) / samples,
+                    static_cast<double>(row.health.contacts_resolved) / samples,
+                    static_cast<double>(row.health.max_penetration),
+                    static_cast<unsigned long long>(row.health.cell_overflows),
+                    static_cast<unsigned long long>(row.health.border_skips));
+    }
+
+    bool writeJson(const std::vector<Row>& rows) const
+    {
+        std::ofstream file{json_path};
+        if (!file) {
+            std::cerr << "Cannot create scaling report " << json_path << std::endl;
+            return false;
+        }
+        file << "{\"world_size\":[" << world_size.x << "," << world_size.y << "],\"measured_updates\":" << measured_updates
+             << ",\"rows\":[";
+        for (uint32_t i{0}; i < rows.size(); ++i) {
+            const Row& row = rows[i];
+            file << (i ? ",\n" : "\n") << "{\"threads\":" << row.threads_count << ",\"density\":" << row.density
+                 << ",\"objects\":" << row.objects_count << ",\"mean_ms\":" << row.mean_ms << ",\"p99_ms\":" << row.p99_ms
+                 << ",\"speedup\":" << row.speedup;
+            if (row.counters_available) {
+                file << ",\"ipc\":" << row.ipc << ",\"cache_misses_per_object\":" << row.cache_misses_per_object
+                     << ",\"branch_misses_per_object\":" << row.branch_misses_per_object;
+            }
+            file << ",\"candidates_tested\":" << row.health.candidates_tested
+                 << ",\"contacts_resolved\":" << row.health.contacts_resolved
+                 << ",\"max_penetration\":" << row.health.max_penetration
+                 << ",\"cell_overflows\":" << row.health.cell_overflows
+                 << ",\"border_skips\":" << row.health.border_skips << "}";
+        }
+        file << "\n]}\n";
+        std::cout << "Wrote scaling report to " << json_path << std::endl;
+        return static_cast<bool>(file);
+    }
+
+    static void fill(PhysicSolver& solver, float density)
+    {
+        const float spacing = 1.0f / std::sqrt(density);
+        const float margin  = 3.0f;
+        const auto  columns = to<uint32_t>((solver.world_size.x - 2.0f * margin) / spacing);
+        const auto  rows    = to<uint32_t>((solver.world_size.y - 2.0f * margin) / spacing);
+        // Ids of a new solver start at 0, they give the lattice index
+        solver.createObjects(columns * rows, [&](civ::ID id, PhysicObject& object) {
+            const auto x = to<float>(id % columns);
+            const auto y = to<float>(id / columns);
+            object.setPosition({margin + x * spacing, margin + y * spacing});
+        });
+    }
+};
@@ -0,0 +1,233 @@
+#pragma once
+#include <cmath>
+#include <cstring>
+#include <vector>
+#include "engine/common/rans_coder.hpp"
+#include "simulation/particle_frame.hpp"
+
+
+// Compression of successive frames of objects.
+// Positions are quantized to fixed point values relative to the grid (cell index and fraction
+// of a cell), each frame stores the difference with the previous frame as zigzag varints
+// followed by the colors of the objects that were not at the same index in the previous frame:
+// first the indices below reference_count whose object changed (objects moved by removals),
+// as a count and index deltas, with their colors, then the colors of the new indices.
+// This byte stream is then entropy coded. Keyframes are encoded against zero.
+struct TrajectoryCodec
+{
+    static constexpr uint32_t file_magic    = 0x52544C56; // "VLTR"
+    static constexpr uint32_t frame_magic   = 0x4D524656; // "VFRM"
+    static constexpr uint32_t version       = 2;
+    static constexpr uint32_t fraction_bits = 10;
+    static constexpr uint32_t keyframe_flag = 1;
+
+    struct FileHeader
+    {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t fraction_bits;
+        uint32_t keyframe_interval;
+        float    world_width;
+        float    world_height;
+    };
+
+    struct FrameHeader
+    {
+        uint32_t magic;
+        uint32_t flags;
+        uint64_t frame_index;
+        uint32_t objects_count;
+        // Number of objects encoded relatively to the previous frame
+        uint32_t reference_count;
+        uint32_t raw_size;
+        uint32_t compressed_size;
+
+        [[nodiscard]]
+        bool isKeyframe() const
+        {
+            return flags & keyframe_flag;
+        }
+    };
+
+    // Quantized positions of the last encoded or decoded frame, x and y interleaved
+    std::vector<int32_t>   reference;
+    // Objects of the last encoded frame
+    std::vector<ObjectIndex> reference_ids;
+    // Colors of the last decoded frame
+    std::vector<sf::Color> reference_colors;
+    // Indices below reference_count whose object changed
+    std::vector<uint32_t>  changed;
+    std::vector<uint8_t>   raw;
+
+    void reset()
+    {
+        reference.clear();
+        reference_ids.clear();
+        reference_colors.clear();
+    }
+
+    // Appends the header and the compressed frame to output
+    void encode(const ParticleFrame& frame, uint64_t frame_index, bool keyframe, std::vector<uint8_t>& output)
+    {
+        const uint32_t objects_count   = frame.size();
+        const uint32_t reference_count = keyframe ? 0 : std::min(objects_count, to<uint32_t>(reference.size() / 2));
+        reference.resize(2 * objects_count);
+        raw.clear();
+        for (uint32_t i{0}; i < objects_count; ++i) {
+            const int32_t x = quantize(frame.positions[i].x);
+            const int32_t y = quantize(frame.positions[i].y);
+            const bool    delta = i < reference_count;
+            writeVarint(zigzag(x - (delta ? reference[2 * i    ] : 0)));
+            writeVarint(zigzag(y - (delta ? reference[2 * i + 1] : 0)));
+            reference[2 * i    ] = x;
+            reference[2 * i + 1] = y;
+        }
+        changed.clear();
+        for (uint32_t i{0}; i < reference_count; ++i) {
+            if (frame.ids[i] != reference_ids[i]) {
+                changed.push_back(i);
+            }
+        }
+        writeVarint(to<uint32_t>(changed.size()));
+        uint32_t previous = 0;
+        for (const uint32_t i : changed) {
+            writeVarint(i - previous);
+            previous = i;
+        }
+        for (const uint32_t i : changed) {
+            writeColor(frame.colors[i]);
+        }
+        for (uint32_t i{reference_count}; i < objects_count; ++i) {
+            writeColor(frame.colors[i]);
+        }
+        reference_ids.assign(frame.ids.begin(), frame.ids.end());
+
+        FrameHeader header{};
+        header.magic           = frame_magic;
+        header.flags           = keyframe ? keyframe_flag : 0;
+        header.frame_index     = frame_index;
+        header.objects_count   = objects_count;
+        header.reference_count = reference_count;
+        header.raw_size        = to<uint32_t>(raw.size());
+        const auto header_start = output.size();
+        output.resize(header_start + sizeof(FrameHeader));
+        RansCoder::encode(raw.data(), header.raw_size, output);
+        header.compressed_size = to<uint32_t>(output.size() - header_start - sizeof(FrameHeader));
+        std::memcpy(output.data() + header_start, &header, sizeof(FrameHeader));
+    }
+
+    // Entropy decoding does not depend on previous frames, it can be done ahead of time on any thread
+    static bool decodeRaw(const FrameHeader& header, const uint8_t* compressed, std::vector<uint8_t>& output)
+    {
+        output.resize(header.raw_size);
+        return RansCoder::decode(compressed, header.compressed_size, output.data(), header.raw_size);
+    }
+
+    // Rebuilds a frame from its raw data, frames have to be applied in order starting from a keyframe
+    bool applyRaw(const FrameHeader& header, const std::vector<uint8_t>& raw_data, ParticleFrame& frame)
+    {
+        if (header.reference_count > reference.size() / 2 || header.reference_count > header.objects_count) {
+            return false;
+        }
+        const uint32_t objects_count = header.objects_count;
+        reference.resize(2 * objects_count);
+        reference_colors.resize(objects_count);
+        frame.positions.resize(objects_count);
+        frame.colors.resize(objects_count);
+
+        const uint8_t* current = raw_data.data();
+        const uint8_t* end     = current + raw_data.size();
+        for (uint32_t i{0}; i < 2 * objects_count; ++i) {
+            uint32_t value;
+            if (!readVarint(current, end, value)) {
+                return false;
+            }
+            const int32_t base = (i / 2 < header.reference_count) ? reference[i] : 0;
+            reference[i] = base + unzigzag(value);
+        }
+        uint32_t changed_count;
+        if (!readVarint(current, end, changed_count) || changed_count > header.reference_count) {
+            return false;
+        }
+        changed.resize(changed_count);
+        uint32_t index = 0;
+        for (uint32_t& i : changed) {
+            uint32_t delta;
+            if (!readVarint(current, end, delta)) {
+                return false;
+            }
+            index += delta;
+            if (index >= header.reference_count) {
+                return false;
+            }
+            i = index;
+        }
+        if (end - current != 4 * static_cast<int64_t>(changed_count + objects_count - header.reference_count)) {
+            return false;
+        }
+        for (const uint32_t i : changed) {
+            reference_colors[i] = {current[0], current[1], current[2], current[3]};
+            current += 4;
+        }
+        for (uint32_t i{header.reference_count}; i < objects_count; ++i, current += 4) {
+            reference_colors[i] = {current[0], current[1], current[2], current[3]};
+        }
+        for (uint32_t i{0}; i < objects_count; ++i) {
+            frame.positions[i] = {dequantize(reference[2 * i]), dequantize(reference[2 * i + 1])};
+        }
+        std::copy(reference_colors.begin(), reference_colors.end(), frame.colors.begin());
+        frame.frame_id = header.frame_index;
+        return true;
+    }
+
+    static int32_t quantize(float v)
+    {
+        return static_cast<int32_t>(std::lround(v * static_cast<float>(1 << fraction_bits)));
+    }
+
+    static float dequantize(int32_t v)
+    {
+        return static_cast<float>(v) / static_cast<float>(1 << fraction_bits);
+    }
+
+private:
+    static uint32_t zigzag(int32_t v)
+    {
+        return (static_cast<uint32_t>(v) << 1) ^ static_cast<uint32_t>(v >> 31);
+    }
+
+    static int32_t unzigzag(uint32_t v)
+    {
+        return static_cast<int32_t>(v >> 1) ^ -static_cast<int32_t>(v & 1);
+    }
+
+    void writeVarint(uint32_t v)
+    {
+        while (v >= 0x80) {
+            raw.push_back(static_cast<uint8_t>(v | 0x80));
+            v >>= 7;
+        }
+        raw.push_back(static_cast<uint8_t>(v));
+    }
+
+    void writeColor(sf::Color color)
+    {
+        raw.insert(raw.end(), {color.r, color.g, color.b, color.a});
+    }
+
+    static bool readVarint(const uint8_t*& current, const uint8_t* end, uint32_t& value)
+    {
+        value = 0;
+        for (uint32_t shift{0}; shift < 35; shift += 7) {
+            if (current == end) {
+                return false;
+            }
+            const uint8_t byte = *current++;
+            value |= static_cast<uint32_t>(byte & 0x7F) << shift;
+            if (!(byte & 0x80)) {
+                return true;
+            }
+        }
+        return false;
+    }
+};
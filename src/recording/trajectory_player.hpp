@@ -0,0 +1,249 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <string>
+#include "trajectory_codec.hpp"
+
+
+// Plays a file written by TrajectoryRecorder.
+// Frames headers are indexed when the file is opened, payloads are streamed from the file.
+// Entropy decoding of the next frames is done ahead of time on the thread pool, only the
+// cheap delta reconstruction is left to the caller. Seeking restarts from the closest
+// previous keyframe, so its cost is bounded by the keyframe interval.
+class TrajectoryPlayer
+{
+public:
+    using FrameHeader = TrajectoryCodec::FrameHeader;
+
+    struct FrameEntry
+    {
+        // Position of the compressed data in the file
+        uint64_t    offset;
+        FrameHeader header;
+    };
+
+    explicit
+    TrajectoryPlayer(tp::ThreadPool& thread_pool, uint32_t prefetch_count = 16)
+        : m_thread_pool{thread_pool}
+        , m_slots(prefetch_count)
+    {}
+
+    ~TrajectoryPlayer()
+    {
+        waitForDecodes();
+    }
+
+    bool open(const std::string& path)
+    {
+        m_file.open(path, std::ios::binary);
+        if (!m_file) {
+            std::cerr << "Cannot open trajectory file " << path << std::endl;
+            return false;
+        }
+        m_file.read(reinterpret_cast<char*>(&m_header), sizeof(m_header));
+        if (!m_file || m_header.magic != TrajectoryCodec::file_magic || m_header.version != TrajectoryCodec::version ||
+            m_header.fraction_bits != TrajectoryCodec::fraction_bits) {
+            std::cerr << "Trajectory file " << path << " has an unsupported format or version" << std::endl;
+            return false;
+        }
+        buildIndex();
+        if (m_entries.empty() || !m_entries.front().header.isKeyframe()) {
+            std::cerr << "Trajectory file " << path << " does not contain any frame" << std::endl;
+            return false;
+        }
+        prefetch();
+        return true;
+    }
+
+    [[nodiscard]]
+    const TrajectoryCodec::FileHeader& getFileHeader() const
+    {
+        return m_header;
+    }
+
+    [[nodiscard]]
+    uint32_t getFramesCount() const
+    {
+        return to<uint32_t>(m_entries.size());
+    }
+
+    // Index of the next frame returned by next()
+    [[nodiscard]]
+    uint32_t getNextFrame() const
+    {
+        return m_next_entry;
+    }
+
+    // Decodes the next frame, returns false at the end of the file or if the frame is corrupted
+    bool next(ParticleFrame& frame)
+    {
+        const uint32_t entry = m_next_entry;
+        if (entry >= m_entries.size()) {
+            return false;
+        }
+        Slot& slot = getSlot(entry);
+        if (slot.entry != entry) {
+            request(entry);
+        }
+        while (!slot.ready.load(std::memory_order_acquire)) {
+            tp::TaskQueue::wait();
+        }
+        if (!slot.success || !m_codec.applyRaw(m_entries[entry].header, slot.raw, frame)) {
+            std::cerr << "Trajectory frame " << entry << " is corrupted" << std::endl;
+            return false;
+        }
+        ++m_next_entry;
+        // The consumed slot is used for the frame right after the prefetch window
+        if (entry + m_slots.size() < m_entries.size()) {
+            request(entry + to<uint32_t>(m_slots.size()));
+        }
+        return true;
+    }
+
+    // Decodes the requested frame, it becomes the last returned frame
+    bool seek(uint32_t entry, ParticleFrame& frame)
+    {
+        if (entry >= m_entries.size()) {
+            return false;
+        }
+        waitForDecodes();
+        for (Slot& slot : m_slots) {
+            slot.entry = invalid_entry;
+        }
+        const auto keyframe_it = std::upper_bound(m_keyframes.begin(), m_keyframes.end(), entry) - 1;
+        const uint32_t keyframe = *keyframe_it;
+        const uint32_t count    = entry - keyframe + 1;
+
+        // Frames of the chain are independent for the entropy decoding
+        m_seek_compressed.resize(count);
+        m_seek_raw.resize(count);
+        std::vector<uint8_t> success(count, 0);
+        for (uint32_t i{0}; i < count; ++i) {
+            readCompressed(keyframe + i, m_seek_compressed[i]);
+        }
+        tp::TaskGroup group;
+        for (uint32_t i{0}; i < count; ++i) {
+            m_thread_pool.addTask(group, [this, i, keyframe, &success]{
+                const FrameHeader& header = m_entries[keyframe + i].header;
+                success[i] = TrajectoryCodec::decodeRaw(header, m_seek_compressed[i].data(), m_seek_raw[i]);
+            });
+        }
+        group.wait();
+
+        m_codec.reset();
+        m_next_entry = keyframe;
+        for (uint32_t i{0}; i < count; ++i) {
+            if (!success[i] || !m_codec.applyRaw(m_entries[keyframe + i].header, m_seek_raw[i], frame)) {
+                std::cerr << "Trajectory frame " << keyframe + i << " is corrupted" << std::endl;
+                return false;
+            }
+            ++m_next_entry;
+        }
+        prefetch();
+        return true;
+    }
+
+private:
+    static constexpr uint32_t invalid_entry = std::numeric_limits<uint32_t>::max();
+
+    // Compressed and decoded data of one frame of the prefetch window
+    struct Slot
+    {
+        uint32_t             entry   = invalid_entry;
+        std::vector<uint8_t> compressed;
+        std::vector<uint8_t> raw;
+        bool                 success = false;
+        std::atomic<bool>    ready   = true;
+    };
+
+    tp::ThreadPool&             m_thread_pool;
+    std::ifstream               m_file;
+    TrajectoryCodec::FileHeader m_header{};
+    std::vector<FrameEntry>     m_entries;
+    // Indexes of keyframes in m_entries, in increasing order
+    std::vector<uint32_t>       m_keyframes;
+
+    TrajectoryCodec             m_codec;
+    std::vector<Slot>           m_slots;
+    uint32_t                    m_next_entry = 0;
+
+    std::vector<std::vector<uint8_t>> m_seek_compressed;
+    std::vector<std::vector<uint8_t>> m_seek_raw;
+
+    void buildIndex()
+    {
+        const uint64_t file_size = getFileSize();
+        uint64_t offset = sizeof(TrajectoryCodec::FileHeader);
+        FrameHeader header{};
+        while (offset + sizeof(FrameHeader) <= file_size) {
+            m_file.seekg(static_cast<std::streamoff>(offset));
+            m_file.read(reinterpret_cast<char*>(&header), sizeof(FrameHeader));
+            offset += sizeof(FrameHeader);
+            // A truncated last frame, left by an interrupted recording, is ignored
+            if (!m_file || header.magic != TrajectoryCodec::frame_magic || offset + header.compressed_size > file_size) {
+                break;
+            }
+            if (header.isKeyframe()) {
+                m_keyframes.push_back(to<uint32_t>(m_entries.size()));
+            }
+            m_entries.push_back({offset, header});
+            offset += header.compressed_size;
+        }
+        m_file.clear();
+    }
+
+    uint64_t getFileSize()
+    {
+        m_file.seekg(0, std::ios::end);
+        const auto size = static_cast<uint64_t>(m_file.tellg());
+        m_file.seekg(0);
+        return size;
+    }
+
+    Slot& getSlot(uint32_t entry)
+    {
+        return m_slots[entry % m_slots.size()];
+    }
+
+    void readCompressed(uint32_t entry, std::vector<uint8_t>& output)
+    {
+        const FrameEntry& frame_entry = m_entries[entry];
+        output.resize(frame_entry.header.compressed_size);
+        m_file.seekg(static_cast<std::streamoff>(frame_entry.offset));
+        m_file.read(reinterpret_cast<char*>(output.data()), static_cast<std::streamsize>(output.size()));
+    }
+
+    // Reads the frame's payload and queues its decoding, the slot must not be in use
+    void request(uint32_t entry)
+    {
+        Slot& slot = getSlot(entry);
+        readCompressed(entry, slot.compressed);
+        slot.entry = entry;
+        slot.ready.store(false, std::memory_order_relaxed);
+        const FrameHeader& header = m_entries[entry].header;
+        m_thread_pool.addTask([&slot, &header]{
+            slot.success = TrajectoryCodec::decodeRaw(header, slot.compressed.data(), slot.raw);
+            slot.ready.store(true, std::memory_order_release);
+        });
+    }
+
+    void prefetch()
+    {
+        const auto end = std::min(to<uint32_t>(m_entries.size()), m_next_entry + to<uint32_t>(m_slots.size()));
+        for (uint32_t entry{m_next_entry}; entry < end; ++entry) {
+            request(entry);
+        }
+    }
+
+    void waitForDecodes() const
+    {
+        for (const Slot& slot : m_slots) {
+            while (!slot.ready.load(std::memory_order_acquire)) {
+                tp::TaskQueue::wait();
+            }
+        }
+    }
+};
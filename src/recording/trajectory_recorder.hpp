@@ -0,0 +1,206 @@
+#pragma once
+#include <condition_variable>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include "trajectory_codec.hpp"
+#include "simulation/frame_capture.hpp"
+#include "engine/common/racc.hpp"
+
+
+// Records the solver's output to a file.
+// Frames captured at the end of each update are queued in a ring, compression and writing
+// are done by a background thread. When the ring is full the frame is dropped instead of
+// waiting, so the cost on the frame time stays bounded to queuing a reference.
+class TrajectoryRecorder
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    explicit
+    TrajectoryRecorder(uint32_t slots_count = 8, uint32_t keyframe_interval = 60)
+        : m_slots(slots_count)
+        , m_keyframe_interval{keyframe_interval}
+        , m_capture_ms(60)
+    {}
+
+    ~TrajectoryRecorder()
+    {
+        stop();
+    }
+
+    bool start(const std::string& path, Vec2 world_size)
+    {
+        m_file.open(path, std::ios::binary | std::ios::trunc);
+        if (!m_file) {
+            std::cerr << "Cannot open trajectory file " << path << std::endl;
+            return false;
+        }
+        TrajectoryCodec::FileHeader header{};
+        header.magic             = TrajectoryCodec::file_magic;
+        header.version           = TrajectoryCodec::version;
+        header.fraction_bits     = TrajectoryCodec::fraction_bits;
+        header.keyframe_interval = m_keyframe_interval;
+        header.world_width       = world_size.x;
+        header.world_height      = world_size.y;
+        m_file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        m_bytes_written = sizeof(header);
+
+        m_running = true;
+        m_thread  = std::thread([this]{
+            run();
+        });
+        return true;
+    }
+
+    // Remaining frames are written before returning
+    void stop()
+    {
+        if (!m_thread.joinable()) {
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock{m_mutex};
+            m_running = false;
+        }
+        m_condition.notify_all();
+        m_thread.join();
+        m_file.close();
+        report();
+    }
+
+    // Consumes the frames captured at the end of the solver's updates
+    void attach(FrameCapture& capture)
+    {
+        capture.addConsumer([this](const FrameCapture::SharedFrame& frame) {
+            push(frame);
+        });
+    }
+
+    // Called by the thread running the solver, never waits for the writer
+    void push(const FrameCapture::SharedFrame& frame)
+    {
+        if (!m_running) {
+            return;
+        }
+        const auto push_start = Clock::now();
+        const uint64_t frame_index = m_captured++;
+        const uint64_t write_index = m_write_index.load(std::memory_order_relaxed);
+        if (write_index - m_read_index.load(std::memory_order_acquire) == m_slots.size()) {
+            ++m_dropped;
+            return;
+        }
+        Slot& slot = m_slots[write_index % m_slots.size()];
+        slot.frame = frame;
+        slot.index = frame_index;
+        m_write_index.store(write_index + 1, std::memory_order_release);
+        {
+            // Only ensures the writer is either waiting or about to check the indexes
+            std::lock_guard<std::mutex> lock{m_mutex};
+        }
+        m_condition.notify_one();
+
+        const std::chrono::duration<float, std::milli> elapsed = Clock::now() - push_start;
+        m_capture_ms.addValue(elapsed.count());
+        m_max_capture_ms = std::max(m_max_capture_ms, elapsed.count());
+    }
+
+    // Average time spent in push over the last frames
+    [[nodiscard]]
+    float getCaptureTime() const
+    {
+        return m_capture_ms.get();
+    }
+
+    [[nodiscard]]
+    uint64_t getDroppedCount() const
+    {
+        return m_dropped;
+    }
+
+private:
+    struct Slot
+    {
+        FrameCapture::SharedFrame frame;
+        // Index in the recording, frames dropped before it are counted
+        uint64_t                  index = 0;
+    };
+
+    std::vector<Slot>          m_slots;
+    uint32_t                   m_keyframe_interval;
+    // Single producer single consumer indexes, slot = index % slots count
+    std::atomic<uint64_t>      m_write_index = 0;
+    std::atomic<uint64_t>      m_read_index  = 0;
+
+    std::thread                m_thread;
+    std::mutex                 m_mutex;
+    std::condition_variable    m_condition;
+    std::atomic<bool>          m_running = false;
+
+    std::ofstream              m_file;
+    TrajectoryCodec            m_codec;
+    std::vector<uint8_t>       m_buffer;
+
+    // Measures, reported when the recording stops
+    uint64_t                   m_captured       = 0;
+    std::atomic<uint64_t>      m_dropped        = 0;
+    uint64_t                   m_encoded        = 0;
+    uint64_t                   m_raw_bytes      = 0;
+    uint64_t                   m_bytes_written  = 0;
+    RMean<float>               m_capture_ms;
+    float                      m_max_capture_ms = 0.0f;
+    float                      m_encode_ms      = 0.0f;
+
+    void run()
+    {
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock{m_mutex};
+                m_condition.wait(lock, [this]{ return !m_running || hasPendingFrame(); });
+                if (!m_running && !hasPendingFrame()) {
+                    return;
+                }
+            }
+            while (hasPendingFrame()) {
+                const uint64_t read_index = m_read_index.load(std::memory_order_relaxed);
+                Slot& slot = m_slots[read_index % m_slots.size()];
+                encode(*slot.frame, slot.index);
+                // Lets the frame capture recycle the frame
+                slot.frame.reset();
+                m_read_index.store(read_index + 1, std::memory_order_release);
+            }
+        }
+    }
+
+    [[nodiscard]]
+    bool hasPendingFrame() const
+    {
+        return m_read_index.load(std::memory_order_relaxed) != m_write_index.load(std::memory_order_acquire);
+    }
+
+    void encode(const ParticleFrame& frame, uint64_t frame_index)
+    {
+        const auto encode_start = Clock::now();
+        const bool keyframe = (m_encoded % m_keyframe_interval) == 0;
+        m_buffer.clear();
+        m_codec.encode(frame, frame_index, keyframe, m_buffer);
+        m_file.write(reinterpret_cast<const char*>(m_buffer.data()), static_cast<std::streamsize>(m_buffer.size()));
+        ++m_encoded;
+        m_raw_bytes     += frame.size() * (sizeof(Vec2) + sizeof(sf::Color));
+        m_bytes_written += m_buffer.size();
+        const std::chrono::duration<float, std::milli> elapsed = Clock::now() - encode_start;
+        m_encode_ms += elapsed.count();
+    }
+
+    void report() const
+    {
+        const auto written = static_cast<double>(m_bytes_written);
+        std::cout << "Recorded " << m_encoded << " frames (" << m_dropped << " dropped), "
+                  << written / (1024.0 * 1024.0) << " MB, compression ratio "
+                  << (written > 0.0 ? static_cast<double>(m_raw_bytes) / written : 0.0) << std::endl;
+        std::cout << "Capture time " << m_capture_ms.get() << " ms (max " << m_max_capture_ms << " ms), encode time "
+                  << (m_encoded ? m_encode_ms / static_cast<float>(m_encoded) : 0.0f) << " ms per frame" << std::endl;
+    }
+};
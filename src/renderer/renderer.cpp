@@ -1,10 +1,12 @@
 #include "renderer.hpp"
+#include <array>
 
 
 Renderer::Renderer(PhysicSolver& solver_, tp::ThreadPool& tp)
     : solver{solver_}
     , world_va{sf::Quads, 4}
     , objects_va{sf::Quads}
+    , hud_va{sf::Quads}
     , thread_pool{tp}
 {
     initializeWorldVA();
@@ -16,15 +18,29 @@ Renderer::Renderer(PhysicSolver& solver_, tp::ThreadPool& tp)
 
 void Renderer::render(RenderContext& context)
 {
-    renderHUD(context);
-    context.draw(world_va);
-
-    sf::RenderStates states;
-    states.texture = &object_texture;
-    context.draw(world_va, states);
-    // Particles
     updateParticlesVA();
-    context.draw(objects_va, states);
+    drawParticles(context);
+}
+
+void Renderer::render(RenderContext& context, const ParticleFrame& frame, const ParticleFrame* previous, float ratio)
+{
+    updateParticlesVA(frame, previous, ratio);
+    drawParticles(context);
+}
+
+void Renderer::drawParticles(RenderContext& context)
+{
+    {
+        VERLET_PROFILE_SCOPE(profiler::Phase::Draw);
+        context.draw(world_va);
+
+        sf::RenderStates states;
+        states.texture = &object_texture;
+        context.draw(world_va, states);
+        // Particles
+        context.draw(objects_va, states);
+    }
+    renderHUD(context);
 }
 
 void Renderer::initializeWorldVA()
@@ -45,43 +61,111 @@ void Renderer::initializeWorldVA()
 void Renderer::updateParticlesVA()
 {
     objects_va.resize(solver.objects.size() * 4);
-
-    const float texture_size = 1024.0f;
-    const float radius       = 0.5f;
     thread_pool.dispatch(to<uint32_t>(solver.objects.size()), [&](uint32_t start, uint32_t end) {
+        VERLET_PROFILE_SCOPE(profiler::Phase::VertexArray);
         for (uint32_t i{start}; i < end; ++i) {
             const PhysicObject& object = solver.objects.data[i];
-            const uint32_t idx = i << 2;
-            objects_va[idx + 0].position = object.position + Vec2{-radius, -radius};
-            objects_va[idx + 1].position = object.position + Vec2{ radius, -radius};
-            objects_va[idx + 2].position = object.position + Vec2{ radius,  radius};
-            objects_va[idx + 3].position = object.position + Vec2{-radius,  radius};
-            objects_va[idx + 0].texCoords = {0.0f        , 0.0f};
-            objects_va[idx + 1].texCoords = {texture_size, 0.0f};
-            objects_va[idx + 2].texCoords = {texture_size, texture_size};
-            objects_va[idx + 3].texCoords = {0.0f        , texture_size};
+            setParticleVertices(i, object.position, object.color);
+        }
+    });
+}
 
-            const sf::Color color = object.color;
-            objects_va[idx + 0].color = color;
-            objects_va[idx + 1].color = color;
-            objects_va[idx + 2].color = color;
-            objects_va[idx + 3].color = color;
+void Renderer::updateParticlesVA(const ParticleFrame& frame, const ParticleFrame* previous, float ratio)
+{
+    objects_va.resize(frame.size() * 4);
+    // Objects created or moved to another index since the previous frame are shown at their current position
+    const uint32_t interpolated_count = (previous && ratio < 1.0f) ? std::min(previous->size(), frame.size()) : 0;
+    thread_pool.dispatch(frame.size(), [&](uint32_t start, uint32_t end) {
+        VERLET_PROFILE_SCOPE(profiler::Phase::VertexArray);
+        for (uint32_t i{start}; i < end; ++i) {
+            Vec2 position = frame.positions[i];
+            if (i < interpolated_count && previous->ids[i] == frame.ids[i]) {
+                position = previous->positions[i] + (position - previous->positions[i]) * ratio;
+            }
+            setParticleVertices(i, position, frame.colors[i]);
         }
     });
 }
 
-void Renderer::renderHUD(RenderContext&)
+void Renderer::setParticleVertices(uint32_t i, Vec2 position, sf::Color color)
+{
+    const float texture_size = 1024.0f;
+    const float radius       = 0.5f;
+    const uint32_t idx = i << 2;
+    objects_va[idx + 0].position = position + Vec2{-radius, -radius};
+    objects_va[idx + 1].position = position + Vec2{ radius, -radius};
+    objects_va[idx + 2].position = position + Vec2{ radius,  radius};
+    objects_va[idx + 3].position = position + Vec2{-radius,  radius};
+    objects_va[idx + 0].texCoords = {0.0f        , 0.0f};
+    objects_va[idx + 1].texCoords = {texture_size, 0.0f};
+    objects_va[idx + 2].texCoords = {texture_size, texture_size};
+    objects_va[idx + 3].texCoords = {0.0f        , texture_size};
+
+    objects_va[idx + 0].color = color;
+    objects_va[idx + 1].color = color;
+    objects_va[idx + 2].color = color;
+    objects_va[idx + 3].color = color;
+}
+
+void Renderer::renderHUD(RenderContext& context)
 {
-    // HUD
-    /*const float margin    = 20.0f;
-    float       current_y = margin;
-    text_time.setString("Simulation time: " + toString(phys_time.get()) + "ms");
-    text_time.setPosition({margin, current_y});
-    current_y += text_time.getBounds().y + 0.5f * margin;
-    context.renderToHUD(text_time, RenderContext::Mode::Normal);
+#ifdef VERLET_PROFILING
+    const std::array<sf::Color, profiler::phases_count> phase_colors = {
+        sf::Color{255, 200,  50}, sf::Color{ 80, 160, 255}, sf::Color{255,  80,  80}, sf::Color{200,  40, 120},
+        sf::Color{ 80, 220, 120}, sf::Color{160, 100, 255}, sf::Color{ 40, 220, 220}, sf::Color{230, 230, 230},
+        sf::Color{120, 120, 120}
+    };
+    const auto add_quad = [this](Vec2 position, Vec2 size, sf::Color color) {
+        hud_va.append({position                     , color});
+        hud_va.append({position + Vec2{size.x, 0.0f}, color});
+        hud_va.append({position + size              , color});
+        hud_va.append({position + Vec2{0.0f, size.y}, color});
+    };
 
-    text_objects.setString("Objects: " + toString(simulation.solver.objects.size()));
-    text_objects.setPosition({margin, current_y});
-    current_y += text_objects.getBounds().y + 0.5f * margin;
-    context.renderToHUD(text_objects, RenderContext::Mode::Normal);*/
+    profiler::Profiler& profiler = profiler::Profiler::get();
+    profiler.collect();
+    hud_va.clear();
+    const float margin = 20.0f;
+    // Mean CPU time of each phase, stacked
+    const float ms_width   = 20.0f;
+    const float bar_height = 12.0f;
+    const auto  sub_step   = static_cast<uint32_t>(profiler::Phase::SubStep);
+    float x = margin;
+    for (uint32_t p{0}; p < sub_step; ++p) {
+        const float width = profiler.getMeanMs(static_cast<profiler::Phase>(p)) * ms_width;
+        add_quad({x, margin}, {width, bar_height}, phase_colors[p]);
+        x += width;
+    }
+    // Frame time p50, p99 and p99.9, on the same scale
+    float y = margin + bar_height + 0.25f * margin;
+    const std::array<double, 3> quantiles = {0.5, 0.99, 0.999};
+    for (uint32_t q{0}; q < quantiles.size(); ++q) {
+        const auto level = to<uint8_t>(230 - 60 * q);
+        add_quad({margin, y}, {profiler.getFrameQuantile(quantiles[q]) * ms_width, 0.5f * bar_height}, sf::Color{level, level, level});
+        y += 0.5f * bar_height + 2.0f;
+    }
+    // Events of the last frame, one lane per thread
+    const float    timeline_width = 600.0f;
+    const float    lane_height    = 6.0f;
+    const uint64_t frame_start    = profiler.getFrameStart();
+    const auto     frame_duration = to<float>(std::max<uint64_t>(1, profiler.getFrameEnd() - frame_start));
+    y += 0.25f * margin;
+    for (const std::vector<profiler::Event>& events : profiler.getFrameEvents()) {
+        add_quad({margin, y}, {timeline_width, lane_height}, sf::Color{0, 0, 0, 150});
+        for (const profiler::Event& event : events) {
+            // Sub steps enclose other phases
+            if (event.phase == profiler::Phase::SubStep) {
+                continue;
+            }
+            const float start = to<float>(std::max(event.start, frame_start) - frame_start) / frame_duration;
+            const float end   = to<float>(std::max(event.end, frame_start) - frame_start) / frame_duration;
+            add_quad({margin + start * timeline_width, y}, {std::max(1.0f, (end - start) * timeline_width), lane_height},
+                     phase_colors[static_cast<uint32_t>(event.phase)]);
+        }
+        y += lane_height + 2.0f;
+    }
+    context.drawDirect(hud_va);
+#else
+    static_cast<void>(context);
+#endif
 }
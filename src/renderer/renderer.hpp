@@ -1,6 +1,7 @@
 #pragma once
 #include <SFML/Graphics.hpp>
 #include "physics/physics.hpp"
+#include "simulation/particle_frame.hpp"
 #include "engine/window_context_handler.hpp"
 
 
@@ -10,6 +11,7 @@ struct Renderer
 
     sf::VertexArray world_va;
     sf::VertexArray objects_va;
+    sf::VertexArray hud_va;
     sf::Texture     object_texture;
 
     tp::ThreadPool& thread_pool;
@@ -19,9 +21,20 @@ struct Renderer
 
     void render(RenderContext& context);
 
+    // Renders a captured frame instead of reading the solver's objects, ratio
+    // is used to interpolate between the previous frame's positions and this one's
+    void render(RenderContext& context, const ParticleFrame& frame, const ParticleFrame* previous = nullptr, float ratio = 1.0f);
+
     void initializeWorldVA();
 
     void updateParticlesVA();
 
+    void updateParticlesVA(const ParticleFrame& frame, const ParticleFrame* previous, float ratio);
+
+    void setParticleVertices(uint32_t i, Vec2 position, sf::Color color);
+
+    void drawParticles(RenderContext& context);
+
+    // Profiler phases' mean times and the last frame's per thread timeline, only with VERLET_PROFILING
     void renderHUD(RenderContext& context);
 };
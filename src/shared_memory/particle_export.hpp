@@ -0,0 +1,158 @@
+#pragma once
+#include <iostream>
+#include <new>
+#include <string>
+#include "particle_export_layout.hpp"
+#include "simulation/frame_capture.hpp"
+
+#if defined(__unix__) || defined(__APPLE__)
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <unistd.h>
+    #define VERLET_SHARED_MEMORY 1
+#endif
+
+
+// Publishes objects' positions and colors in a POSIX shared memory object after each update,
+// copied from the frame captured for all consumers. Readers of other processes map it read
+// only, see ParticleExportReader. The writer never waits for readers, it fills the oldest
+// slot so a reader has slots_count - 1 updates to consume a frame before it is overwritten,
+// which the sequence counter lets it detect.
+class ParticleExport
+{
+public:
+    ParticleExport(tp::ThreadPool& thread_pool, uint32_t capacity, uint32_t slots_count = 4)
+        : m_thread_pool{thread_pool}
+        , m_capacity{capacity}
+        , m_slots_count{slots_count}
+        , m_size{particle_export::getMappingSize(capacity, slots_count)}
+    {}
+
+    ~ParticleExport()
+    {
+        close();
+    }
+
+    ParticleExport(const ParticleExport&) = delete;
+    ParticleExport& operator=(const ParticleExport&) = delete;
+
+    // Name follows shm_open rules, for instance "/verlet_particles".
+    // An object left with this name (previous run, crashed writer) is unlinked instead of being
+    // reused: readers still mapping it keep their own copy, which never receives frames again,
+    // and the new object is zero filled so readers ignore it until the magic is written.
+    bool create(const std::string& name, Vec2 world_size)
+    {
+#ifdef VERLET_SHARED_MEMORY
+        close();
+        shm_unlink(name.c_str());
+        const int32_t fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+        if (fd < 0 || ftruncate(fd, static_cast<off_t>(m_size)) < 0) {
+            std::cerr << "Cannot create shared memory " << name << std::endl;
+            if (fd >= 0) {
+                ::close(fd);
+            }
+            return false;
+        }
+        void* mapping = mmap(nullptr, m_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (mapping == MAP_FAILED) {
+            std::cerr << "Cannot map shared memory " << name << std::endl;
+            shm_unlink(name.c_str());
+            return false;
+        }
+        m_name      = name;
+        m_mapping   = static_cast<uint8_t*>(mapping);
+        m_next_slot = 0;
+        m_frame_id  = 0;
+
+        auto* header = new (m_mapping) particle_export::Header{};
+        header->version      = particle_export::version;
+        header->slots_count  = m_slots_count;
+        header->capacity     = m_capacity;
+        header->slot_size    = particle_export::getSlotSize(m_capacity);
+        header->world_width  = world_size.x;
+        header->world_height = world_size.y;
+        header->latest_slot.store(m_slots_count, std::memory_order_relaxed);
+        for (uint32_t i{0}; i < m_slots_count; ++i) {
+            new (getSlot(i)) particle_export::SlotHeader{};
+        }
+        // Written last, the layout is complete once readers see it
+        header->magic.store(particle_export::magic, std::memory_order_release);
+        return true;
+#else
+        std::cerr << "Shared memory export is not supported on this platform (" << name << ")" << std::endl;
+        static_cast<void>(world_size);
+        return false;
+#endif
+    }
+
+    void close()
+    {
+#ifdef VERLET_SHARED_MEMORY
+        if (m_mapping) {
+            munmap(m_mapping, m_size);
+            shm_unlink(m_name.c_str());
+            m_mapping = nullptr;
+        }
+#endif
+    }
+
+    // Consumes the frames captured at the end of the solver's updates
+    void attach(FrameCapture& capture)
+    {
+        capture.addConsumer([this](const FrameCapture::SharedFrame& frame) {
+            publish(*frame);
+        });
+    }
+
+    // Objects beyond the capacity are not exported
+    void publish(const ParticleFrame& frame)
+    {
+        if (!m_mapping) {
+            return;
+        }
+        const uint32_t slot_index = m_next_slot;
+        m_next_slot = (m_next_slot + 1) % m_slots_count;
+        auto* slot = getSlot(slot_index);
+        auto* positions = reinterpret_cast<float*>(slot + 1);
+        auto* colors    = reinterpret_cast<uint32_t*>(positions + 2 * m_capacity);
+
+        const uint64_t sequence = slot->sequence.load(std::memory_order_relaxed);
+        slot->sequence.store(sequence + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        const uint32_t objects_count = std::min(frame.size(), m_capacity);
+        m_thread_pool.dispatch(objects_count, [&](uint32_t start, uint32_t end) {
+            for (uint32_t i{start}; i < end; ++i) {
+                positions[2 * i    ] = frame.positions[i].x;
+                positions[2 * i + 1] = frame.positions[i].y;
+                colors[i] = frame.colors[i].toInteger();
+            }
+        });
+        slot->frame_id      = ++m_frame_id;
+        slot->objects_count = objects_count;
+        slot->sequence.store(sequence + 2, std::memory_order_release);
+        getHeader()->latest_slot.store(slot_index, std::memory_order_release);
+    }
+
+private:
+    tp::ThreadPool& m_thread_pool;
+    uint32_t        m_capacity;
+    uint32_t        m_slots_count;
+    uint64_t        m_size;
+    std::string     m_name;
+    uint8_t*        m_mapping   = nullptr;
+    uint32_t        m_next_slot = 0;
+    uint64_t        m_frame_id  = 0;
+
+    particle_export::Header* getHeader()
+    {
+        return reinterpret_cast<particle_export::Header*>(m_mapping);
+    }
+
+    particle_export::SlotHeader* getSlot(uint32_t i)
+    {
+        const uint64_t offset = particle_export::getFirstSlotOffset() + i * particle_export::getSlotSize(m_capacity);
+        return reinterpret_cast<particle_export::SlotHeader*>(m_mapping + offset);
+    }
+};
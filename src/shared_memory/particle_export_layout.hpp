@@ -0,0 +1,63 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+
+
+// Memory layout of the shared particle export, shared by the writer and the readers.
+// Header, then slots_count slots. Each slot is a SlotHeader followed by capacity positions
+// (x and y floats) and capacity colors (sf::Color::toInteger, 0xRRGGBBAA).
+// Slots are protected by a sequence counter: odd while the writer fills the slot,
+// incremented again once the slot is complete.
+namespace particle_export
+{
+
+constexpr uint32_t magic     = 0x58454C56; // "VLEX"
+constexpr uint32_t version   = 1;
+constexpr uint64_t alignment = 64;
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "Sequence counters are shared between processes");
+static_assert(std::atomic<uint32_t>::is_always_lock_free, "The magic and the latest slot are shared between processes");
+
+struct Header
+{
+    // Stored last by the writer once the rest of the layout is initialized
+    std::atomic<uint32_t> magic;
+    uint32_t              version;
+    uint32_t              slots_count;
+    // Maximum objects count of a slot
+    uint32_t              capacity;
+    uint64_t              slot_size;
+    float                 world_width;
+    float                 world_height;
+    // Index of the last completed slot, slots_count before the first publication
+    std::atomic<uint32_t> latest_slot;
+};
+
+struct alignas(alignment) SlotHeader
+{
+    std::atomic<uint64_t> sequence;
+    uint64_t              frame_id;
+    uint32_t              objects_count;
+};
+
+inline uint64_t align(uint64_t offset)
+{
+    return (offset + alignment - 1) / alignment * alignment;
+}
+
+inline uint64_t getSlotSize(uint32_t capacity)
+{
+    return align(sizeof(SlotHeader) + capacity * (2 * sizeof(float) + sizeof(uint32_t)));
+}
+
+inline uint64_t getFirstSlotOffset()
+{
+    return align(sizeof(Header));
+}
+
+inline uint64_t getMappingSize(uint32_t capacity, uint32_t slots_count)
+{
+    return getFirstSlotOffset() + slots_count * getSlotSize(capacity);
+}
+
+}
@@ -0,0 +1,153 @@
+#pragma once
+#include <string>
+#include "particle_export_layout.hpp"
+
+#if defined(__unix__) || defined(__APPLE__)
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+    #define VERLET_SHARED_MEMORY 1
+#endif
+
+
+// Reads frames published by ParticleExport from another process, without copying them.
+// Only depends on the layout header so it can be dropped in external tools.
+//
+//     ParticleExportReader reader;
+//     reader.open("/verlet_particles");
+//     ParticleExportReader::FrameView frame;
+//     if (reader.acquire(frame)) {
+//         process(frame.positions, frame.colors, frame.objects_count);
+//         if (!reader.validate(frame)) {
+//             // The writer reused the slot while it was processed, results must be discarded
+//         }
+//     }
+class ParticleExportReader
+{
+public:
+    struct FrameView
+    {
+        uint64_t        frame_id      = 0;
+        uint32_t        objects_count = 0;
+        // x and y interleaved
+        const float*    positions     = nullptr;
+        // sf::Color::toInteger values, 0xRRGGBBAA
+        const uint32_t* colors        = nullptr;
+        uint32_t        slot          = 0;
+        uint64_t        sequence      = 0;
+    };
+
+    ParticleExportReader() = default;
+
+    ~ParticleExportReader()
+    {
+        close();
+    }
+
+    ParticleExportReader(const ParticleExportReader&) = delete;
+    ParticleExportReader& operator=(const ParticleExportReader&) = delete;
+
+    bool open(const std::string& name)
+    {
+#ifdef VERLET_SHARED_MEMORY
+        close();
+        const int32_t fd = shm_open(name.c_str(), O_RDONLY, 0);
+        if (fd < 0) {
+            return false;
+        }
+        struct stat shm_stat{};
+        if (fstat(fd, &shm_stat) < 0 || static_cast<uint64_t>(shm_stat.st_size) < sizeof(particle_export::Header)) {
+            ::close(fd);
+            return false;
+        }
+        m_size = static_cast<uint64_t>(shm_stat.st_size);
+        void* mapping = mmap(nullptr, m_size, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (mapping == MAP_FAILED) {
+            return false;
+        }
+        m_mapping       = static_cast<const uint8_t*>(mapping);
+        m_last_frame_id = 0;
+        const particle_export::Header* header = getHeader();
+        // The writer stores the magic last, the other fields are complete once it is visible
+        const bool valid = header->magic.load(std::memory_order_acquire) == particle_export::magic &&
+                           header->version == particle_export::version &&
+                           header->slot_size == particle_export::getSlotSize(header->capacity) &&
+                           particle_export::getMappingSize(header->capacity, header->slots_count) <= m_size;
+        if (!valid) {
+            close();
+        }
+        return valid;
+#else
+        static_cast<void>(name);
+        return false;
+#endif
+    }
+
+    void close()
+    {
+#ifdef VERLET_SHARED_MEMORY
+        if (m_mapping) {
+            munmap(const_cast<uint8_t*>(m_mapping), m_size);
+            m_mapping = nullptr;
+        }
+#endif
+    }
+
+    [[nodiscard]]
+    const particle_export::Header* getHeader() const
+    {
+        return reinterpret_cast<const particle_export::Header*>(m_mapping);
+    }
+
+    // Points the view to the most recent frame, returns false if there is no frame newer than the last acquired one
+    bool acquire(FrameView& view)
+    {
+        const particle_export::Header* header = getHeader();
+        // The writer may be filling the latest slot again, a few retries are enough to get a complete one
+        for (uint32_t attempt{0}; attempt < header->slots_count; ++attempt) {
+            const uint32_t slot_index = header->latest_slot.load(std::memory_order_acquire);
+            if (slot_index >= header->slots_count) {
+                return false;
+            }
+            const particle_export::SlotHeader* slot = getSlot(slot_index);
+            const uint64_t sequence = slot->sequence.load(std::memory_order_acquire);
+            if (sequence & 1) {
+                continue;
+            }
+            view.frame_id      = slot->frame_id;
+            view.objects_count = slot->objects_count;
+            view.positions     = reinterpret_cast<const float*>(slot + 1);
+            view.colors        = reinterpret_cast<const uint32_t*>(view.positions + 2 * header->capacity);
+            view.slot          = slot_index;
+            view.sequence      = sequence;
+            if (!validate(view) || view.frame_id == m_last_frame_id) {
+                return false;
+            }
+            m_last_frame_id = view.frame_id;
+            return true;
+        }
+        return false;
+    }
+
+    // Returns true if the frame was not modified since it was acquired
+    [[nodiscard]]
+    bool validate(const FrameView& view) const
+    {
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return getSlot(view.slot)->sequence.load(std::memory_order_relaxed) == view.sequence;
+    }
+
+private:
+    const uint8_t* m_mapping       = nullptr;
+    uint64_t       m_size          = 0;
+    uint64_t       m_last_frame_id = 0;
+
+    [[nodiscard]]
+    const particle_export::SlotHeader* getSlot(uint32_t i) const
+    {
+        const uint64_t offset = particle_export::getFirstSlotOffset() + i * getHeader()->slot_size;
+        return reinterpret_cast<const particle_export::SlotHeader*>(m_mapping + offset);
+    }
+};
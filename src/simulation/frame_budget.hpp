@@ -0,0 +1,73 @@
+#pragma once
+#include <algorithm>
+#include <iostream>
+#include "engine/common/racc.hpp"
+
+
+// Caps the objects count to what the machine can update and render within the frame budget.
+// The load is the solve and render time over the budget, averaged over a few frames. Above
+// high_load the cap is set to the current count, below low_load it is lifted so that emission
+// resumes, the gap between both avoids oscillations. The cap never exceeds max_objects_count.
+struct FrameBudget
+{
+    bool         enabled           = true;
+    // Time available for one frame, and for one update when the simulation has its own thread
+    float        frame_ms          = 1000.0f / 60.0f;
+    float        update_ms         = 1000.0f / 60.0f;
+    // Solve and render run concurrently, each has its own budget
+    bool         overlapped        = false;
+    float        high_load         = 0.9f;
+    float        low_load          = 0.7f;
+    uint32_t     max_objects_count = 0;
+    uint32_t     cap               = 0;
+    // Largest count at which the budget was reached, 0 if it never was
+    uint32_t     capacity          = 0;
+    RMean<float> load{30};
+    uint32_t     frames_count      = 0;
+
+    FrameBudget(uint32_t max_count, float frame_budget_ms, float update_budget_ms, bool overlapped_)
+        : frame_ms{frame_budget_ms}
+        , update_ms{update_budget_ms}
+        , overlapped{overlapped_}
+        , max_objects_count{max_count}
+        , cap{max_count}
+    {}
+
+    [[nodiscard]]
+    float getLoad(float solve_ms, float render_ms) const
+    {
+        if (overlapped) {
+            return std::max(solve_ms / update_ms, render_ms / frame_ms);
+        }
+        return (solve_ms + render_ms) / frame_ms;
+    }
+
+    // Called once per frame, returns true if the cap changed
+    bool update(float solve_ms, float render_ms, uint32_t objects_count)
+    {
+        if (!enabled) {
+            return false;
+        }
+        load.addValue(getLoad(solve_ms, render_ms));
+        // The mean needs a full window to be meaningful, and a change to be reflected in it
+        if (++frames_count < load.max_values_count) {
+            return false;
+        }
+        const float mean = load.get();
+        if (mean > high_load && cap > objects_count) {
+            cap      = objects_count;
+            capacity = std::max(capacity, objects_count);
+            std::cout << "Frame budget reached at " << objects_count << " objects (load " << mean * 100.0f
+                      << "%, solve " << solve_ms << " ms, render " << render_ms << " ms)" << std::endl;
+        } else if (mean < low_load && cap < max_objects_count && objects_count >= cap) {
+            cap = max_objects_count;
+            std::cout << "Frame budget available again at " << objects_count << " objects (load " << mean * 100.0f
+                      << "%), emission resumed" << std::endl;
+        } else {
+            return false;
+        }
+        load         = RMean<float>{load.max_values_count};
+        frames_count = 0;
+        return true;
+    }
+};
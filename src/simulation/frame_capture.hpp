@@ -0,0 +1,75 @@
+#pragma once
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <vector>
+#include "particle_frame.hpp"
+
+
+// Captures the solver's objects once at the end of each update and hands the same frame to every
+// consumer (renderer, recorder, broadcaster, shared memory export). Frames are immutable once
+// handed out, consumers keep them as long as they need. A frame is recycled when the capture is
+// its only owner left, so buffers are only reallocated when the objects count grows.
+class FrameCapture
+{
+public:
+    using SharedFrame = std::shared_ptr<const ParticleFrame>;
+    using Consumer    = std::function<void(const SharedFrame&)>;
+
+    FrameCapture(PhysicSolver& solver, tp::ThreadPool& thread_pool)
+        : m_thread_pool{thread_pool}
+    {
+        solver.update_callbacks.emplace_back([this](const PhysicSolver& s) {
+            capture(s);
+        });
+    }
+
+    FrameCapture(const FrameCapture&) = delete;
+    FrameCapture& operator=(const FrameCapture&) = delete;
+
+    // Consumers are called by the thread running the solver, they cannot be added while it runs
+    void addConsumer(Consumer consumer)
+    {
+        m_consumers.push_back(std::move(consumer));
+    }
+
+    // Nothing is copied while no one consumes frames
+    void capture(const PhysicSolver& solver)
+    {
+        if (m_consumers.empty()) {
+            return;
+        }
+        const std::shared_ptr<ParticleFrame>& frame = getFreeFrame();
+        frame->capture(solver, m_thread_pool);
+        frame->frame_id = ++m_captured;
+        const SharedFrame shared = frame;
+        for (const Consumer& consumer : m_consumers) {
+            consumer(shared);
+        }
+    }
+
+    // Frames allocated so far, bounded by the number of frames consumers hold at once
+    [[nodiscard]]
+    uint64_t getFramesCount() const
+    {
+        return m_frames.size();
+    }
+
+private:
+    tp::ThreadPool&                             m_thread_pool;
+    std::vector<Consumer>                       m_consumers;
+    std::vector<std::shared_ptr<ParticleFrame>> m_frames;
+    uint64_t                                    m_captured = 0;
+
+    const std::shared_ptr<ParticleFrame>& getFreeFrame()
+    {
+        for (const std::shared_ptr<ParticleFrame>& frame : m_frames) {
+            if (frame.use_count() == 1) {
+                // Pairs with the release of the last consumer's reference, its reads are done
+                std::atomic_thread_fence(std::memory_order_acquire);
+                return frame;
+            }
+        }
+        return m_frames.emplace_back(std::make_shared<ParticleFrame>());
+    }
+};
@@ -0,0 +1,41 @@
+#pragma once
+#include <vector>
+#include "physics/physics.hpp"
+
+
+// Render data of all objects at the end of a solver update
+struct ParticleFrame
+{
+    uint64_t               frame_id = 0;
+    std::vector<Vec2>      positions;
+    std::vector<sf::Color> colors;
+    // Validity id of each object, unlike object ids it is never reused by a later object
+    std::vector<ObjectIndex> ids;
+    SolverHealth           health;
+    float                  update_ms = 0.0f;
+
+    [[nodiscard]]
+    uint32_t size() const
+    {
+        return to<uint32_t>(positions.size());
+    }
+
+    // Copies objects' data, buffers are only reallocated when the objects count grows
+    void capture(const PhysicSolver& solver, tp::ThreadPool& thread_pool)
+    {
+        const auto objects_count = to<uint32_t>(solver.objects.size());
+        positions.resize(objects_count);
+        colors.resize(objects_count);
+        ids.resize(objects_count);
+        health    = solver.health;
+        update_ms = solver.last_update_ms;
+        thread_pool.dispatch(objects_count, [&](uint32_t start, uint32_t end) {
+            for (uint32_t i{start}; i < end; ++i) {
+                const PhysicObject& object = solver.objects.data[i];
+                positions[i] = object.position;
+                colors[i]    = object.color;
+                ids[i]       = solver.objects.metadata[i].op_id;
+            }
+        });
+    }
+};
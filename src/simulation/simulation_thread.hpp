@@ -0,0 +1,185 @@
+#pragma once
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include "frame_capture.hpp"
+#include "engine/common/triple_buffer.hpp"
+
+
+// Runs the solver on its own thread, the hand-off of frames to the renderer
+// is done through a triple buffer so it only costs an index swap. Frames come
+// from the frame capture shared with the other consumers, they are not copied.
+class SimulationThread
+{
+public:
+    using SolverCallback = std::function<void(PhysicSolver&)>;
+    using Clock          = std::chrono::steady_clock;
+
+    enum class Pacing
+    {
+        // One update per rendered frame, frame N + 1 is solved while frame N is rendered
+        Lockstep,
+        // Updates follow the wall clock with a fixed time step, presentation is interpolated
+        FixedStep,
+    };
+
+    struct PresentedFrame
+    {
+        FrameCapture::SharedFrame frame;
+        // Previous published state, only kept when presentation is interpolated
+        FrameCapture::SharedFrame previous;
+        uint64_t                  id = 0;
+        // Wall clock time at which this state becomes the current one
+        Clock::time_point         time;
+    };
+
+    SimulationThread(PhysicSolver& solver, FrameCapture& capture, float dt, Pacing pacing = Pacing::Lockstep)
+        : m_solver{solver}
+        , m_capture{capture}
+        , m_dt{dt}
+        , m_pacing{pacing}
+    {
+        // Until the first update is published
+        const auto empty = std::make_shared<const ParticleFrame>();
+        for (PresentedFrame& presented : m_frames.buffers) {
+            presented.frame = empty;
+        }
+    }
+
+    ~SimulationThread()
+    {
+        stop();
+    }
+
+    // Called on the simulation thread before each update
+    void setPreUpdateCallback(SolverCallback callback)
+    {
+        m_pre_update = std::move(callback);
+    }
+
+    void start()
+    {
+        m_capture.addConsumer([this](const FrameCapture::SharedFrame& frame) {
+            m_last_frame = frame;
+        });
+        m_running = true;
+        m_thread  = std::thread([this]{
+            run();
+        });
+    }
+
+    void stop()
+    {
+        if (!m_thread.joinable()) {
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock{m_mutex};
+            m_running = false;
+        }
+        m_condition.notify_all();
+        m_thread.join();
+    }
+
+    // Queues a modification of the solver, executed between two updates
+    void post(SolverCallback command)
+    {
+        std::lock_guard<std::mutex> lock{m_mutex};
+        m_commands.push_back(std::move(command));
+    }
+
+    // Returns the most recent frame, allowing the simulation to start the next one
+    const PresentedFrame& acquireFrame()
+    {
+        if (m_frames.acquire()) {
+            {
+                std::lock_guard<std::mutex> lock{m_mutex};
+                m_consumed = m_frames.getReadBuffer().id;
+            }
+            m_condition.notify_all();
+        }
+        return m_frames.getReadBuffer();
+    }
+
+    // Position of the present time between the frame's previous and current states.
+    // The presented state lags one step behind the simulation to always have both ends available.
+    [[nodiscard]]
+    float getInterpolationRatio(const PresentedFrame& presented) const
+    {
+        if (m_pacing != Pacing::FixedStep || !presented.previous) {
+            return 1.0f;
+        }
+        const std::chrono::duration<float> to_state = presented.time - Clock::now();
+        return std::min(std::max(1.0f - to_state.count() / m_dt, 0.0f), 1.0f);
+    }
+
+private:
+    PhysicSolver&                m_solver;
+    FrameCapture&                m_capture;
+    float                        m_dt;
+    Pacing                       m_pacing;
+    SolverCallback               m_pre_update;
+    // Maximum number of steps performed to catch up with the wall clock before dropping time
+    uint32_t                     m_max_catch_up = 4;
+
+    std::thread                  m_thread;
+    std::mutex                   m_mutex;
+    std::condition_variable      m_condition;
+    bool                         m_running   = false;
+    uint64_t                     m_published = 0;
+    uint64_t                     m_consumed  = 0;
+    std::vector<SolverCallback>  m_commands;
+
+    TripleBuffer<PresentedFrame> m_frames;
+    // Captured by the last update
+    FrameCapture::SharedFrame    m_last_frame;
+    FrameCapture::SharedFrame    m_previous_frame;
+
+    void run()
+    {
+        const auto step_duration = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<float>(m_dt));
+        auto next_step = Clock::now();
+        std::vector<SolverCallback> commands;
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock{m_mutex};
+                if (m_pacing == Pacing::Lockstep) {
+                    // Wait for the renderer to pick the last published frame
+                    m_condition.wait(lock, [this]{ return !m_running || m_consumed == m_published; });
+                } else {
+                    m_condition.wait_until(lock, next_step, [this]{ return !m_running; });
+                }
+                if (!m_running) {
+                    return;
+                }
+                commands.swap(m_commands);
+            }
+            for (SolverCallback& command : commands) {
+                command(m_solver);
+            }
+            commands.clear();
+
+            if (m_pre_update) {
+                m_pre_update(m_solver);
+            }
+            m_solver.update(m_dt);
+
+            PresentedFrame& presented = m_frames.getWriteBuffer();
+            presented.frame = m_last_frame;
+            presented.id    = ++m_published;
+            if (m_pacing == Pacing::FixedStep) {
+                next_step += step_duration;
+                // If the solver cannot keep up, simulation time is dropped instead of accumulating lag
+                const auto now = Clock::now();
+                if (now - next_step > m_max_catch_up * step_duration) {
+                    next_step = now;
+                }
+                presented.time     = next_step;
+                presented.previous = m_previous_frame;
+                m_previous_frame   = m_last_frame;
+            }
+            m_frames.publish();
+        }
+    }
+};
@@ -0,0 +1,131 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(__linux__)
+    #include <sched.h>
+    #include <sys/syscall.h>
+    #include <unistd.h>
+    #define VERLET_NUMA 1
+#endif
+
+
+namespace tp
+{
+
+// NUMA nodes and the CPUs this process may run on, read from sysfs. Other platforms, or
+// machines without NUMA information, are described as a single node with all hardware threads.
+struct CpuTopology
+{
+    struct Node
+    {
+        int32_t               id = 0;
+        std::vector<uint32_t> cpus;
+    };
+
+    std::vector<Node> nodes;
+
+    static CpuTopology detect()
+    {
+        CpuTopology topology;
+#ifdef VERLET_NUMA
+        // Restricted by taskset or a cgroup's cpuset
+        cpu_set_t allowed;
+        CPU_ZERO(&allowed);
+        const bool restricted = sched_getaffinity(0, sizeof(allowed), &allowed) == 0;
+        std::ifstream online{"/sys/devices/system/node/online"};
+        std::string   online_list;
+        if (std::getline(online, online_list)) {
+            for (const uint32_t id : parseList(online_list)) {
+                std::ifstream cpu_list{"/sys/devices/system/node/node" + std::to_string(id) + "/cpulist"};
+                std::string   list;
+                Node node;
+                node.id = static_cast<int32_t>(id);
+                if (std::getline(cpu_list, list)) {
+                    for (const uint32_t cpu : parseList(list)) {
+                        if (!restricted || (cpu < CPU_SETSIZE && CPU_ISSET(cpu, &allowed))) {
+                            node.cpus.push_back(cpu);
+                        }
+                    }
+                }
+                // Memory only nodes have no CPU to pin workers on
+                if (!node.cpus.empty()) {
+                    topology.nodes.push_back(node);
+                }
+            }
+        }
+#endif
+        if (topology.nodes.empty()) {
+            topology.nodes.emplace_back();
+            for (uint32_t cpu{0}; cpu < std::max(1u, std::thread::hardware_concurrency()); ++cpu) {
+                topology.nodes.back().cpus.push_back(cpu);
+            }
+        }
+        return topology;
+    }
+
+    // Parses sysfs lists such as "0-3,8-11"
+    static std::vector<uint32_t> parseList(const std::string& list)
+    {
+        std::vector<uint32_t> result;
+        uint64_t start = 0;
+        while (start < list.size()) {
+            uint64_t end = list.find(',', start);
+            if (end == std::string::npos) {
+                end = list.size();
+            }
+            const std::string range = list.substr(start, end - start);
+            const uint64_t    dash  = range.find('-');
+            try {
+                const auto first = static_cast<uint32_t>(std::stoul(range.substr(0, dash)));
+                const auto last  = dash == std::string::npos ? first : static_cast<uint32_t>(std::stoul(range.substr(dash + 1)));
+                for (uint32_t i{first}; i <= last; ++i) {
+                    result.push_back(i);
+                }
+            } catch (const std::exception&) {
+                // Empty or malformed entry, ignored
+            }
+            start = end + 1;
+        }
+        return result;
+    }
+
+    // Moves the pages of an array to the node returned by get_node(index) for the first element
+    // of each page. Pages that were never touched are skipped by the kernel, they will be placed
+    // by the thread touching them first. Returns false if pages could not be moved.
+    template<typename T, typename TCallback>
+    static bool place(const T* data, uint64_t count, TCallback&& get_node)
+    {
+#ifdef VERLET_NUMA
+        if (!count) {
+            return true;
+        }
+        const auto page_size = static_cast<uintptr_t>(sysconf(_SC_PAGESIZE));
+        const auto begin     = reinterpret_cast<uintptr_t>(data);
+        const auto end       = reinterpret_cast<uintptr_t>(data + count);
+        std::vector<void*>   pages;
+        std::vector<int32_t> page_nodes;
+        for (uintptr_t page{begin - begin % page_size}; page < end; page += page_size) {
+            const uintptr_t first = std::max(page, begin);
+            pages.push_back(reinterpret_cast<void*>(page));
+            page_nodes.push_back(get_node((first - begin) / sizeof(T)));
+        }
+        std::vector<int32_t> status(pages.size());
+        // MPOL_MF_MOVE from numaif.h, only pages used by this process alone are moved
+        constexpr int32_t move_flag = 1 << 1;
+        return syscall(SYS_move_pages, 0, pages.size(), pages.data(), page_nodes.data(), status.data(), move_flag) >= 0;
+#else
+        static_cast<void>(data);
+        static_cast<void>(count);
+        static_cast<void>(get_node);
+        return false;
+#endif
+    }
+};
+
+}
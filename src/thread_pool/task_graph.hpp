@@ -0,0 +1,95 @@
+#pragma once
+#include "thread_pool.hpp"
+
+
+namespace tp
+{
+
+// Set of tasks with dependencies, a task is pushed to the thread pool as soon as
+// all the tasks it depends on are done instead of waiting for a global barrier.
+// The graph can be executed several times, dependencies counters are reset on each run.
+struct TaskGraph
+{
+    struct Node
+    {
+        std::function<void()> task;
+        std::vector<uint32_t> successors;
+        uint32_t              dependencies_count = 0;
+        // Worker owning the task, see ThreadPool::addTask
+        int32_t               worker             = any_worker;
+    };
+
+    static constexpr int32_t any_worker = -1;
+
+    std::vector<Node>                  m_nodes;
+    std::vector<std::atomic<uint32_t>> m_remaining_dependencies;
+
+    template<typename TCallback>
+    uint32_t addNode(TCallback&& callback, int32_t worker = any_worker)
+    {
+        m_nodes.emplace_back();
+        m_nodes.back().task   = std::forward<TCallback>(callback);
+        m_nodes.back().worker = worker;
+        return static_cast<uint32_t>(m_nodes.size() - 1);
+    }
+
+    // Declares that the task 'after' cannot start before the task 'before' is done
+    void addDependency(uint32_t before, uint32_t after)
+    {
+        m_nodes[before].successors.push_back(after);
+        ++m_nodes[after].dependencies_count;
+    }
+
+    void clear()
+    {
+        m_nodes.clear();
+    }
+
+    [[nodiscard]]
+    bool empty() const
+    {
+        return m_nodes.empty();
+    }
+
+    // Runs all the tasks and waits for their completion
+    void run(ThreadPool& thread_pool)
+    {
+        const auto nodes_count = static_cast<uint32_t>(m_nodes.size());
+        if (m_remaining_dependencies.size() != nodes_count) {
+            m_remaining_dependencies = std::vector<std::atomic<uint32_t>>(nodes_count);
+        }
+        for (uint32_t i{0}; i < nodes_count; ++i) {
+            m_remaining_dependencies[i] = m_nodes[i].dependencies_count;
+        }
+        TaskGroup group;
+        for (uint32_t i{0}; i < nodes_count; ++i) {
+            if (m_nodes[i].dependencies_count == 0) {
+                schedule(thread_pool, group, i);
+            }
+        }
+        // Successors are added before their predecessor is marked as done so the group never looks empty too early
+        group.wait();
+    }
+
+private:
+    void schedule(ThreadPool& thread_pool, TaskGroup& group, uint32_t node_id)
+    {
+        const auto task = [this, &thread_pool, &group, node_id]{
+            const Node& node = m_nodes[node_id];
+            node.task();
+            for (const uint32_t successor : node.successors) {
+                if (--m_remaining_dependencies[successor] == 0) {
+                    schedule(thread_pool, group, successor);
+                }
+            }
+        };
+        const int32_t worker = m_nodes[node_id].worker;
+        if (worker == any_worker) {
+            thread_pool.addTask(group, task);
+        } else {
+            thread_pool.addTask(group, static_cast<uint32_t>(worker), task);
+        }
+    }
+};
+
+}
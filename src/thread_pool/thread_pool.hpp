@@ -1,38 +1,115 @@
 #pragma once
+#include <chrono>
 #include <functional>
+#include <memory>
 #include <queue>
 #include <vector>
 #include <thread>
 #include <mutex>
 #include <atomic>
+#include "cpu_topology.hpp"
+
+#if defined(__linux__)
+    #include <pthread.h>
+    #define VERLET_THREAD_AFFINITY 1
+#endif
 
 
 namespace tp
 {
 
+// Nanoseconds on the steady clock, used to timestamp traced tasks
+inline uint64_t getTraceTime()
+{
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+struct Task
+{
+    std::function<void()> callback     = nullptr;
+    // Only set while tracing, 0 otherwise
+    uint64_t              enqueue_time = 0;
+};
+
+// Execution of a traced task by a worker
+struct TaskRecord
+{
+    uint64_t enqueue_time;
+    uint64_t start_time;
+    uint64_t end_time;
+};
+
+// Records of one worker, only written by it. The ring is allocated before tracing is first
+// enabled and never resized. Tasks queued while tracing can still end after it is disabled,
+// readers hold the mutex while copying records, it is only taken by workers for traced tasks.
+struct TaskTrace
+{
+    std::vector<TaskRecord> m_records;
+    std::atomic<uint64_t>   m_written   = 0;
+    // Nanoseconds spent running tasks while accounting or tracing was enabled
+    std::atomic<uint64_t>   m_busy_time = 0;
+    mutable std::mutex      m_mutex;
+
+    void push(const TaskRecord& record)
+    {
+        std::lock_guard<std::mutex> lock{m_mutex};
+        const uint64_t index = m_written.load(std::memory_order_relaxed);
+        m_records[index % m_records.size()] = record;
+        m_written.store(index + 1, std::memory_order_release);
+    }
+};
+
+// Placement of the workers on the machine's CPUs
+enum class Affinity
+{
+    // Workers are moved freely by the OS scheduler
+    None,
+    // Each worker is pinned to one CPU, consecutive workers share a node
+    Cores,
+    // Each worker is pinned to all the CPUs of one NUMA node
+    Nodes,
+};
+
 struct TaskQueue
 {
-    std::queue<std::function<void()>> m_tasks;
-    std::mutex                        m_mutex;
-    std::atomic<uint32_t>             m_remaining_tasks = 0;
+    std::queue<Task>      m_tasks;
+    // Tasks that can only be executed by one worker, protected by the same mutex
+    std::vector<std::queue<Task>> m_worker_tasks;
+    std::mutex            m_mutex;
+    std::atomic<uint32_t> m_remaining_tasks = 0;
+    std::atomic<bool>     m_tracing         = false;
+    std::atomic<bool>     m_accounting      = false;
 
     template<typename TCallback>
     void addTask(TCallback&& callback)
     {
+        const uint64_t enqueue_time = m_tracing.load(std::memory_order_relaxed) ? getTraceTime() : 0;
         std::lock_guard<std::mutex> lock_guard{m_mutex};
-        m_tasks.push(std::forward<TCallback>(callback));
+        m_tasks.push({std::forward<TCallback>(callback), enqueue_time});
         m_remaining_tasks++;
     }
 
-    void getTask(std::function<void()>& target_callback)
+    template<typename TCallback>
+    void addTask(uint32_t worker, TCallback&& callback)
+    {
+        const uint64_t enqueue_time = m_tracing.load(std::memory_order_relaxed) ? getTraceTime() : 0;
+        std::lock_guard<std::mutex> lock_guard{m_mutex};
+        m_worker_tasks[worker].push({std::forward<TCallback>(callback), enqueue_time});
+        m_remaining_tasks++;
+    }
+
+    // The worker's own tasks come first
+    void getTask(Task& target_task, uint32_t worker)
     {
         {
             std::lock_guard<std::mutex> lock_guard{m_mutex};
-            if (m_tasks.empty()) {
+            std::queue<Task>& tasks = m_worker_tasks[worker].empty() ? m_tasks : m_worker_tasks[worker];
+            if (tasks.empty()) {
                 return;
             }
-            target_callback = std::move(m_tasks.front());
-            m_tasks.pop();
+            target_task = std::move(tasks.front());
+            tasks.pop();
         }
     }
 
@@ -54,13 +131,29 @@ struct TaskQueue
     }
 };
 
+// Completion counter of a batch of tasks, the thread that added them only waits for its own
+// tasks instead of all the pool's, see ThreadPool::addTask
+struct TaskGroup
+{
+    std::atomic<uint32_t> remaining = 0;
+
+    void wait() const
+    {
+        while (remaining > 0) {
+            TaskQueue::wait();
+        }
+    }
+};
+
 struct Worker
 {
-    uint32_t              m_id      = 0;
-    std::thread           m_thread;
-    std::function<void()> m_task    = nullptr;
-    bool                  m_running = true;
-    TaskQueue*            m_queue   = nullptr;
+    uint32_t                   m_id      = 0;
+    std::thread                m_thread;
+    Task                       m_task;
+    bool                       m_running = true;
+    TaskQueue*                 m_queue   = nullptr;
+    // Not stored inline to keep workers movable
+    std::unique_ptr<TaskTrace> m_trace   = std::make_unique<TaskTrace>();
 
     Worker() = default;
 
@@ -76,13 +169,23 @@ struct Worker
     void run()
     {
         while (m_running) {
-            m_queue->getTask(m_task);
-            if (m_task == nullptr) {
+            m_queue->getTask(m_task, m_id);
+            if (m_task.callback == nullptr) {
                 TaskQueue::wait();
+            } else if (m_task.enqueue_time || m_queue->m_accounting.load(std::memory_order_relaxed)) {
+                const uint64_t start_time = getTraceTime();
+                m_task.callback();
+                const uint64_t end_time = getTraceTime();
+                m_trace->m_busy_time.fetch_add(end_time - start_time, std::memory_order_relaxed);
+                if (m_task.enqueue_time) {
+                    m_trace->push({m_task.enqueue_time, start_time, end_time});
+                }
+                m_queue->workDone();
+                m_task = {};
             } else {
-                m_task();
+                m_task.callback();
                 m_queue->workDone();
-                m_task = nullptr;
+                m_task = {};
             }
         }
     }
@@ -96,14 +199,19 @@ struct Worker
 
 struct ThreadPool
 {
-    uint32_t            m_thread_count = 0;
-    TaskQueue           m_queue;
-    std::vector<Worker> m_workers;
+    uint32_t             m_thread_count = 0;
+    TaskQueue            m_queue;
+    std::vector<Worker>  m_workers;
+    Affinity             m_affinity     = Affinity::None;
+    // NUMA node of each worker once pinned
+    std::vector<int32_t> m_worker_nodes;
 
     explicit
     ThreadPool(uint32_t thread_count)
         : m_thread_count{thread_count}
+        , m_worker_nodes(thread_count, 0)
     {
+        m_queue.m_worker_tasks.resize(thread_count);
         m_workers.reserve(thread_count);
         for (uint32_t i{thread_count}; i--;) {
             m_workers.emplace_back(m_queue, static_cast<uint32_t>(m_workers.size()));
@@ -123,19 +231,170 @@ struct ThreadPool
         m_queue.addTask(std::forward<TCallback>(callback));
     }
 
+    // Task owned by a worker, so that the data it works on stays in this worker's caches and
+    // NUMA node from one call to the next. Only enforced when workers are pinned, any worker
+    // may run it otherwise. Waiting for it from a task would deadlock if both share a worker.
+    template<typename TCallback>
+    void addTask(uint32_t worker, TCallback&& callback)
+    {
+        if (m_affinity == Affinity::None) {
+            m_queue.addTask(std::forward<TCallback>(callback));
+        } else {
+            m_queue.addTask(worker % m_thread_count, std::forward<TCallback>(callback));
+        }
+    }
+
+    // Task counted in the group, the group has to outlive it
+    template<typename TCallback>
+    void addTask(TaskGroup& group, TCallback&& callback)
+    {
+        ++group.remaining;
+        addTask([&group, callback = std::forward<TCallback>(callback)]{
+            callback();
+            --group.remaining;
+        });
+    }
+
+    template<typename TCallback>
+    void addTask(TaskGroup& group, uint32_t worker, TCallback&& callback)
+    {
+        ++group.remaining;
+        addTask(worker, [&group, callback = std::forward<TCallback>(callback)]{
+            callback();
+            --group.remaining;
+        });
+    }
+
+    // Waits for all the pool's tasks, whoever added them. Prefer a TaskGroup when other threads
+    // may be adding tasks concurrently.
     void waitForCompletion() const
     {
         m_queue.waitForCompletion();
     }
 
+    // Pins the workers and makes task ownership stable, see addTask. Workers are spread over
+    // the nodes in order so that neighbouring stripes of work stay on the same node. If a worker
+    // cannot be pinned, all workers get their previous masks back and the affinity is unchanged.
+    bool setAffinity(Affinity affinity, const CpuTopology& topology = CpuTopology::detect())
+    {
+#ifdef VERLET_THREAD_AFFINITY
+        std::vector<uint32_t> cpus;
+        std::vector<int32_t>  cpu_nodes;
+        for (const CpuTopology::Node& node : topology.nodes) {
+            for (const uint32_t cpu : node.cpus) {
+                cpus.push_back(cpu);
+                cpu_nodes.push_back(node.id);
+            }
+        }
+        const auto nodes_count = static_cast<uint32_t>(topology.nodes.size());
+        std::vector<cpu_set_t> previous_sets(m_thread_count);
+        const std::vector<int32_t> previous_nodes = m_worker_nodes;
+        uint32_t applied = 0;
+        for (uint32_t i{0}; i < m_thread_count; ++i) {
+            const pthread_t thread = m_workers[i].m_thread.native_handle();
+            if (pthread_getaffinity_np(thread, sizeof(cpu_set_t), &previous_sets[i]) != 0) {
+                break;
+            }
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            if (affinity == Affinity::Cores) {
+                // Workers are spread evenly over the CPUs, with more workers than CPUs consecutive workers share one
+                const uint32_t cpu_index = static_cast<uint32_t>(static_cast<uint64_t>(i) * cpus.size() / m_thread_count);
+                CPU_SET(cpus[cpu_index], &set);
+                m_worker_nodes[i] = cpu_nodes[cpu_index];
+            } else if (affinity == Affinity::Nodes) {
+                const CpuTopology::Node& node = topology.nodes[i * nodes_count / m_thread_count];
+                for (const uint32_t cpu : node.cpus) {
+                    CPU_SET(cpu, &set);
+                }
+                m_worker_nodes[i] = node.id;
+            } else {
+                // Back to any allowed CPU
+                for (const uint32_t cpu : cpus) {
+                    CPU_SET(cpu, &set);
+                }
+                m_worker_nodes[i] = 0;
+            }
+            if (pthread_setaffinity_np(thread, sizeof(set), &set) != 0) {
+                break;
+            }
+            applied = i + 1;
+        }
+        if (applied < m_thread_count) {
+            for (uint32_t i{0}; i < applied; ++i) {
+                pthread_setaffinity_np(m_workers[i].m_thread.native_handle(), sizeof(cpu_set_t), &previous_sets[i]);
+            }
+            m_worker_nodes = previous_nodes;
+            return false;
+        }
+        m_affinity = affinity;
+        return true;
+#else
+        static_cast<void>(topology);
+        return affinity == Affinity::None;
+#endif
+    }
+
+    [[nodiscard]]
+    bool isPinned() const
+    {
+        return m_affinity != Affinity::None;
+    }
+
+    [[nodiscard]]
+    int32_t getWorkerNode(uint32_t worker) const
+    {
+        return m_worker_nodes[worker % m_thread_count];
+    }
+
+    // Tasks added while tracing are timestamped and recorded by the worker executing them,
+    // each worker keeps its last records_count records
+    void setTracing(bool enabled, uint32_t records_count = 1 << 16)
+    {
+        if (enabled) {
+            for (Worker& worker : m_workers) {
+                // Rings are never reallocated, a worker may still be recording
+                std::lock_guard<std::mutex> lock{worker.m_trace->m_mutex};
+                if (worker.m_trace->m_records.empty()) {
+                    worker.m_trace->m_records.resize(records_count);
+                }
+            }
+        }
+        m_queue.m_tracing = enabled;
+    }
+
+    [[nodiscard]]
+    bool isTracing() const
+    {
+        return m_queue.m_tracing;
+    }
+
+    // Workers measure the time spent in tasks, see getBusyTime
+    void setBusyAccounting(bool enabled)
+    {
+        m_queue.m_accounting = enabled;
+    }
+
+    // Nanoseconds the worker spent running tasks, can be read from any thread
+    [[nodiscard]]
+    uint64_t getBusyTime(uint32_t worker) const
+    {
+        return m_workers[worker].m_trace->m_busy_time.load(std::memory_order_relaxed);
+    }
+
+    // Only waits for its own tasks, allowing several threads to dispatch work concurrently.
+    // Batch i belongs to worker i, see addTask.
     template<typename TCallback>
     void dispatch(uint32_t element_count, TCallback&& callback)
     {
+        TaskGroup group;
         const uint32_t batch_size = element_count / m_thread_count;
         for (uint32_t i{0}; i < m_thread_count; ++i) {
             const uint32_t start = batch_size * i;
             const uint32_t end   = start + batch_size;
-            addTask([start, end, &callback](){ callback(start, end); });
+            addTask(group, i, [start, end, &callback](){
+                callback(start, end);
+            });
         }
 
         if (batch_size * m_thread_count < element_count) {
@@ -143,7 +402,7 @@ struct ThreadPool
             callback(start, element_count);
         }
 
-        waitForCompletion();
+        group.wait();
     }
 };
 
@@ -0,0 +1,123 @@
+#pragma once
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include "thread_pool.hpp"
+
+
+namespace tp
+{
+
+// Records the thread pool's tasks during a window of frames and writes them as Chrome
+// trace-event JSON, readable by chrome://tracing or Perfetto. Each worker is a thread of
+// the trace, tasks are complete events carrying their queue wait and frames are instants.
+class TraceCapture
+{
+public:
+    explicit
+    TraceCapture(ThreadPool& thread_pool)
+        : m_thread_pool{thread_pool}
+    {}
+
+    // Traces the next frames_count frames then writes them to path
+    void start(const std::string& path, uint32_t frames_count)
+    {
+        if (isCapturing()) {
+            return;
+        }
+        m_path            = path;
+        m_frames_count    = frames_count;
+        m_frame_times.clear();
+        m_thread_pool.setTracing(true);
+        m_first_records.clear();
+        for (const Worker& worker : m_thread_pool.m_workers) {
+            m_first_records.push_back(worker.m_trace->m_written.load(std::memory_order_acquire));
+        }
+        m_frame_times.push_back(getTraceTime());
+    }
+
+    [[nodiscard]]
+    bool isCapturing() const
+    {
+        return m_frames_count > 0;
+    }
+
+    // Marks the end of a frame, has to be called once per frame on the thread that started the capture
+    void onFrame()
+    {
+        if (!isCapturing()) {
+            return;
+        }
+        m_frame_times.push_back(getTraceTime());
+        if (--m_frames_count == 0) {
+            m_thread_pool.setTracing(false);
+            if (write()) {
+                std::cout << "Wrote trace of " << m_frame_times.size() - 1 << " frames to " << m_path << std::endl;
+            }
+        }
+    }
+
+private:
+    ThreadPool&           m_thread_pool;
+    std::string           m_path;
+    uint32_t              m_frames_count = 0;
+    std::vector<uint64_t> m_frame_times;
+    std::vector<uint64_t> m_first_records;
+
+    bool write() const
+    {
+        std::ofstream file{m_path};
+        if (!file) {
+            std::cerr << "Cannot create trace " << m_path << std::endl;
+            return false;
+        }
+        const uint64_t origin = m_frame_times.front();
+        // Microseconds relative to the beginning of the capture
+        const auto to_us = [origin](uint64_t t) {
+            char buffer[32];
+            std::snprintf(buffer, sizeof(buffer), "%.3f", static_cast<double>(t - std::min(t, origin)) * 1e-3);
+            return std::string{buffer};
+        };
+
+        file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+        file << R"({"name":"thread_name","ph":"M","pid":1,"tid":0,"args":{"name":"frames"}})";
+        uint64_t dropped = 0;
+        for (uint32_t w{0}; w < m_thread_pool.m_workers.size(); ++w) {
+            const TaskTrace& trace = *m_thread_pool.m_workers[w].m_trace;
+            const uint32_t   tid   = w + 1;
+            file << ",\n" << R"({"name":"thread_name","ph":"M","pid":1,"tid":)" << tid
+                 << R"(,"args":{"name":"worker )" << w << "\"}}";
+            // Copied under the ring's lock, workers may still be recording tasks queued before the end
+            std::vector<TaskRecord> records;
+            {
+                std::lock_guard<std::mutex> lock{trace.m_mutex};
+                const uint64_t written  = trace.m_written.load(std::memory_order_relaxed);
+                const uint64_t capacity = trace.m_records.size();
+                const uint64_t first    = std::max(m_first_records[w], written - std::min(written, capacity));
+                dropped += first - m_first_records[w];
+                for (uint64_t i{first}; i < written; ++i) {
+                    records.push_back(trace.m_records[i % capacity]);
+                }
+            }
+            for (const TaskRecord& record : records) {
+                file << ",\n" << R"({"name":"task","cat":"thread_pool","ph":"X","pid":1,"tid":)" << tid
+                     << ",\"ts\":" << to_us(record.start_time)
+                     << ",\"dur\":" << to_us(origin + record.end_time - record.start_time)
+                     << ",\"args\":{\"queue_wait_us\":" << to_us(origin + record.start_time - record.enqueue_time) << "}}";
+            }
+        }
+        for (uint32_t f{0}; f < m_frame_times.size(); ++f) {
+            file << ",\n" << R"({"name":"frame )" << f << R"(","ph":"i","s":"g","pid":1,"tid":0,"ts":)" << to_us(m_frame_times[f]) << "}";
+        }
+        file << "\n]}\n";
+        if (dropped) {
+            std::cout << dropped << " tasks were overwritten before the trace was written" << std::endl;
+        }
+        return static_cast<bool>(file);
+    }
+};
+
+}
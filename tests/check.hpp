@@ -0,0 +1,32 @@
+#pragma once
+#include <cstdint>
+#include <iostream>
+#include <string>
+
+
+// Checks shared by the tests, a failed check is printed and the test then exits with a non zero code
+namespace test
+{
+
+inline uint32_t failures = 0;
+
+inline void check(bool condition, const std::string& message)
+{
+    if (!condition) {
+        std::cout << "FAILED: " << message << std::endl;
+        ++failures;
+    }
+}
+
+// Prints the result, returns the test's exit code
+inline int32_t report()
+{
+    if (failures) {
+        std::cout << failures << " checks failed" << std::endl;
+        return 1;
+    }
+    std::cout << "All checks passed" << std::endl;
+    return 0;
+}
+
+}
@@ -0,0 +1,140 @@
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <string>
+#include "check.hpp"
+#include "physics/physics.hpp"
+
+
+// Compares the compact objects mode (VERLET_COMPACT_OBJECTS) to the float mode. The same source
+// is built in both modes: the float build writes its measures to a reference file with --write,
+// the compact build runs the same scenes and compares its measures with --compare.
+// Both builds also check the free fall against the analytic trajectory.
+
+namespace
+{
+
+using test::check;
+
+using Measures = std::map<std::string, double>;
+
+constexpr float    dt            = 1.0f / 60.0f;
+constexpr uint32_t threads_count = 4;
+// Velocity damping of PhysicObject::update, a drag proportional to the sub step duration
+constexpr float    damping       = 40.0f;
+
+// One object falling from rest, its height is sampled every frame until it nears the floor
+void measureFreeFall(Measures& measures)
+{
+    tp::ThreadPool thread_pool{threads_count};
+    PhysicSolver   solver{{40, 200}, thread_pool};
+    const Vec2     start{20.0f, 10.0f};
+    const uint64_t id = solver.createObject(start);
+    const double   h  = dt / to<double>(solver.sub_steps);
+    const double   g  = solver.gravity.y;
+    const double   c  = damping * h;
+    double max_error = 0.0;
+    for (uint32_t frame{1}; frame <= 60; ++frame) {
+        solver.update(dt);
+        const double t = frame * to<double>(dt);
+        const double y = solver.objects[id].position.y;
+        // Fall from rest with a linear drag, Verlet starting from rest is ahead of it by about g * h * t / 2
+        const double expected  = start.y + g / c * t - g / (c * c) * (1.0 - std::exp(-c * t));
+        const double tolerance = 0.5 * g * h * t + 5e-3;
+        max_error = std::max(max_error, std::abs(y - expected) - tolerance);
+        if (frame % 10 == 0) {
+            measures["free_fall_y_" + std::to_string(frame)] = y;
+        }
+    }
+    check(max_error <= 0.0, "free fall follows the analytic trajectory");
+    measures["free_fall_x"] = solver.objects[id].position.x;
+}
+
+// Objects thrown into the world until they form a pile, measured once it settled
+void measureSettledPile(Measures& measures)
+{
+    tp::ThreadPool thread_pool{threads_count};
+    PhysicSolver   solver{{60, 60}, thread_pool};
+    for (uint32_t frame{0}; frame < 600; ++frame) {
+        if (frame < 200) {
+            for (uint32_t i{0}; i < 10; ++i) {
+                const uint64_t id = solver.createObject({2.0f, 10.0f + 1.1f * to<float>(i)});
+                solver.objects[id].addVelocity({0.2f, 0.0f});
+            }
+        }
+        solver.update(dt);
+    }
+    double mean_y     = 0.0;
+    double top        = solver.world_size.y;
+    double mean_speed = 0.0;
+    for (const PhysicObject& object : solver.objects) {
+        mean_y     += object.position.y;
+        top         = std::min(top, to<double>(object.position.y));
+        mean_speed += object.getSpeed();
+    }
+    const auto count = to<double>(solver.objects.size());
+    measures["pile_count"]           = count;
+    measures["pile_mean_y"]          = mean_y / count;
+    measures["pile_top"]             = top;
+    measures["pile_mean_speed"]      = mean_speed / count;
+    measures["pile_max_penetration"] = solver.health.max_penetration;
+}
+
+// Allowed difference with the float mode for each measure
+double getTolerance(const std::string& name)
+{
+    if (name == "pile_count") {
+        return 0.0;
+    }
+    if (name == "pile_top" || name == "pile_max_penetration") {
+        return 0.05;
+    }
+    if (name == "pile_mean_speed") {
+        return 1e-3;
+    }
+    return 1e-2;
+}
+
+}
+
+
+int main(int argc, char** argv)
+{
+    const std::string mode = argc == 3 ? argv[1] : "";
+    if (mode != "--write" && mode != "--compare") {
+        std::cout << "Usage: " << argv[0] << " --write|--compare <reference file>" << std::endl;
+        return 1;
+    }
+    Measures measures;
+    measureFreeFall(measures);
+    measureSettledPile(measures);
+
+    if (mode == "--write") {
+        std::ofstream file{argv[2]};
+        file.precision(9);
+        for (const auto& [name, value] : measures) {
+            file << name << ' ' << value << '\n';
+        }
+        check(static_cast<bool>(file), "reference written");
+    } else {
+        std::ifstream file{argv[2]};
+        Measures reference;
+        std::string name;
+        double      value;
+        while (file >> name >> value) {
+            reference[name] = value;
+        }
+        check(reference.size() == measures.size(), "reference has the same measures");
+        for (const auto& [name, value] : measures) {
+            const auto it = reference.find(name);
+            if (it == reference.end()) {
+                continue;
+            }
+            const double difference = std::abs(value - it->second);
+            std::cout << name << ": " << value << " (float " << it->second << ")" << std::endl;
+            check(difference <= getTolerance(name), name + " matches the float mode");
+        }
+    }
+    return test::report();
+}
@@ -0,0 +1,91 @@
+#include <cmath>
+#include <vector>
+#include "check.hpp"
+#include "engine/common/number_generator.hpp"
+#include "physics/physics.hpp"
+
+
+// Checks CounterRNG against the Philox4x32-10 known answers of the Random123 reference
+// implementation, and that emissions do not depend on the thread pool's size.
+
+namespace
+{
+
+using test::check;
+
+void testKnownAnswers()
+{
+    const CounterRNG::Block zeros = CounterRNG::philox({0, 0, 0, 0}, {0, 0});
+    check(zeros == CounterRNG::Block{0x6627e8d5, 0xe169c58d, 0xbc57ac4c, 0x9b00dbd8}, "Philox of zeros");
+    const CounterRNG::Block ones = CounterRNG::philox({0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff}, {0xffffffff, 0xffffffff});
+    check(ones == CounterRNG::Block{0x408f276d, 0x41c83b0e, 0xa20bc7c6, 0x6d5451fd}, "Philox of ones");
+    const CounterRNG::Block pi = CounterRNG::philox({0x243f6a88, 0x85a308d3, 0x13198a2e, 0x03707344}, {0xa4093822, 0x299f31d0});
+    check(pi == CounterRNG::Block{0xd16cfe09, 0x94fdcceb, 0x5001e420, 0x24126ea1}, "Philox of pi digits");
+}
+
+void testDraws()
+{
+    const CounterRNG rng{42, 3};
+    std::vector<float> values(10000);
+    rng.fill(values.data(), to<uint32_t>(values.size()), 100, 5);
+    bool in_range = true;
+    bool same     = true;
+    double sum    = 0.0;
+    for (uint32_t i{0}; i < values.size(); ++i) {
+        in_range = in_range && values[i] >= 0.0f && values[i] < 1.0f;
+        same     = same && values[i] == rng.get(100 + i, 5);
+        sum     += values[i];
+    }
+    check(in_range, "draws are in [0, 1)");
+    check(same, "fill gives the same draws as get");
+    check(std::abs(sum / to<double>(values.size()) - 0.5) < 0.01, "draws are centered");
+    check(rng.get(7, 0) != CounterRNG{42, 4}.get(7, 0), "streams are independent");
+}
+
+std::vector<Vec2> emit(uint32_t threads_count)
+{
+    tp::ThreadPool thread_pool{threads_count};
+    PhysicSolver   solver{{100, 100}, thread_pool};
+    Emitter emitter;
+    emitter.shape           = Emitter::Shape::Disk;
+    emitter.position        = {50.0f, 30.0f};
+    emitter.size            = {10.0f, 0.0f};
+    emitter.rate            = 6000.0f;
+    emitter.velocity_jitter = 3.0f;
+    emitter.seed            = 11;
+    solver.emitters         = {emitter};
+    for (uint32_t frame{0}; frame < 30; ++frame) {
+        solver.emitObjects(solver.emitters[0], 1.0f / 60.0f);
+    }
+    std::vector<Vec2> result;
+    for (const PhysicObject& object : solver.objects) {
+        result.push_back(object.position);
+        result.push_back(object.last_position);
+    }
+    return result;
+}
+
+void testEmissionReproducibility()
+{
+    const std::vector<Vec2> reference = emit(1);
+    check(!reference.empty(), "objects are emitted");
+    for (const uint32_t threads_count : {3u, 7u}) {
+        const std::vector<Vec2> result = emit(threads_count);
+        bool same = result.size() == reference.size();
+        for (uint32_t i{0}; same && i < result.size(); ++i) {
+            same = result[i].x == reference[i].x && result[i].y == reference[i].y;
+        }
+        check(same, "emission does not depend on the threads count");
+    }
+}
+
+}
+
+
+int main()
+{
+    testKnownAnswers();
+    testDraws();
+    testEmissionReproducibility();
+    return test::report();
+}
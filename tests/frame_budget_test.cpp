@@ -0,0 +1,89 @@
+#include "check.hpp"
+#include "simulation/frame_budget.hpp"
+
+
+// Drives FrameBudget with synthetic frame times: the cap follows the load with hysteresis,
+// only once the averaging window is full, and never exceeds the maximum objects count.
+
+namespace
+{
+
+using test::check;
+
+constexpr uint32_t max_count = 10000;
+constexpr float    budget_ms = 10.0f;
+
+// Returns the number of frames after which the cap changed, 0 if it did not
+uint32_t run(FrameBudget& budget, uint32_t frames, float solve_ms, float render_ms, uint32_t objects_count)
+{
+    for (uint32_t frame{1}; frame <= frames; ++frame) {
+        if (budget.update(solve_ms, render_ms, objects_count)) {
+            return frame;
+        }
+    }
+    return 0;
+}
+
+void testHysteresis()
+{
+    FrameBudget budget{max_count, budget_ms, budget_ms, false};
+    const uint32_t window = budget.load.max_values_count;
+    check(run(budget, 3 * window, 4.0f, 2.0f, 5000) == 0, "no change under the low load");
+
+    // 95% of the budget, the cap is set once the rolling mean crosses the high load
+    const uint32_t reached = run(budget, 3 * window, 6.0f, 3.5f, 6000);
+    check(reached > window / 2 && reached <= window, "cap set within a window above the high load");
+    check(budget.cap == 6000 && budget.capacity == 6000, "cap set to the objects count");
+
+    // Between both thresholds nothing changes
+    check(run(budget, 3 * window, 5.0f, 3.0f, 6000) == 0, "no change between the thresholds");
+    check(budget.cap == 6000, "cap kept between the thresholds");
+
+    const uint32_t lifted = run(budget, 3 * window, 3.0f, 2.0f, 6000);
+    check(lifted > 0 && lifted <= window, "cap lifted within a window below the low load");
+    check(budget.cap == max_count && budget.capacity == 6000, "cap lifted to the maximum, capacity kept");
+}
+
+void testLimits()
+{
+    FrameBudget fresh{max_count, budget_ms, budget_ms, false};
+    const uint32_t window = fresh.load.max_values_count;
+    // The mean is only used once its window is full
+    check(run(fresh, window - 1, 20.0f, 20.0f, 5000) == 0 && run(fresh, 1, 20.0f, 20.0f, 5000) == 1, "no change before the window is full");
+
+    FrameBudget budget{max_count, budget_ms, budget_ms, false};
+    // Over budget with the cap already below the count, there is nothing to lower
+    budget.cap = 4000;
+    check(run(budget, 3 * window, 10.0f, 10.0f, 5000) == 0, "cap not raised by an overload");
+    check(budget.cap == 4000, "cap kept under an overload");
+
+    // Emission did not reach the cap yet, the cap is not lifted either
+    FrameBudget below{max_count, budget_ms, budget_ms, false};
+    below.cap = 4000;
+    check(run(below, 3 * window, 1.0f, 1.0f, 3000) == 0 && below.cap == 4000, "cap not lifted before the count reaches it");
+
+    FrameBudget disabled{max_count, budget_ms, budget_ms, false};
+    disabled.enabled = false;
+    check(run(disabled, 3 * window, 20.0f, 20.0f, 5000) == 0 && disabled.cap == max_count, "disabled budget never changes the cap");
+}
+
+void testOverlapped()
+{
+    // Solve and render run concurrently, each one is compared to its own budget
+    FrameBudget overlapped{max_count, budget_ms, 2.0f * budget_ms, true};
+    check(overlapped.getLoad(15.0f, 6.0f) == 0.75f, "solve load over the update budget");
+    check(overlapped.getLoad(4.0f, 8.0f) == 0.8f, "render load over the frame budget");
+    FrameBudget sequential{max_count, budget_ms, budget_ms, false};
+    check(sequential.getLoad(4.0f, 4.0f) == 0.8f, "sequential load is the sum over the frame budget");
+}
+
+}
+
+
+int main()
+{
+    testHysteresis();
+    testLimits();
+    testOverlapped();
+    return test::report();
+}
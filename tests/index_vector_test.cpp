@@ -0,0 +1,111 @@
+#include <algorithm>
+#include <string>
+#include <vector>
+#include "check.hpp"
+#include "engine/common/index_vector.hpp"
+
+
+// Batched removals of civ::Vector: references to the remaining objects must keep resolving to the
+// same objects, references to removed ones must be invalid, and removed ids must be reused.
+
+namespace
+{
+
+using test::check;
+
+// Each object stores the id it was created with
+using Vector = civ::Vector<uint64_t, uint32_t>;
+using Ref    = civ::Ref<uint64_t, uint32_t>;
+
+struct Scene
+{
+    Vector           objects;
+    std::vector<Ref> refs;
+
+    explicit
+    Scene(uint64_t count)
+    {
+        for (uint64_t i{0}; i < count; ++i) {
+            const civ::ID id = objects.emplace_back();
+            objects[id] = id;
+            refs.push_back(objects.getRef(id));
+        }
+    }
+
+    // Flags are indexed by position in data, removed_ids receives the ids of the flagged objects
+    void remove(const std::vector<uint8_t>& marked, std::vector<civ::ID>& removed_ids)
+    {
+        for (uint64_t i{0}; i < marked.size(); ++i) {
+            if (marked[i]) {
+                removed_ids.push_back(objects.getID(i));
+            }
+        }
+        objects.remove_marked(marked);
+    }
+};
+
+// Every reference is valid exactly when its object was kept, and then still points to that object
+void checkReferences(const Scene& scene, const std::vector<civ::ID>& removed_ids, const std::string& name)
+{
+    bool references_valid = true;
+    for (const Ref& ref : scene.refs) {
+        const bool removed = std::find(removed_ids.begin(), removed_ids.end(), ref.getID()) != removed_ids.end();
+        references_valid &= static_cast<bool>(ref) != removed && (removed || *ref == ref.getID());
+    }
+    check(references_valid, name + ": references of kept objects resolve to them, others are invalid");
+    bool slots_consistent = true;
+    for (uint64_t i{0}; i < scene.objects.size(); ++i) {
+        const civ::ID id = scene.objects.getID(i);
+        slots_consistent &= scene.objects.getDataID(id) == i && scene.objects.data[i] == id;
+    }
+    check(slots_consistent, name + ": kept objects are packed and their ids point to them");
+}
+
+void testRemoval(uint64_t count, const std::vector<uint8_t>& marked, const std::string& name)
+{
+    Scene scene{count};
+    std::vector<civ::ID> removed_ids;
+    scene.remove(marked, removed_ids);
+    check(scene.objects.size() == count - removed_ids.size(), name + ": objects count");
+    checkReferences(scene, removed_ids, name);
+
+    // New objects take the removed ids before any new slot is created
+    const uint64_t slots_count = scene.objects.data.size();
+    std::vector<civ::ID> reused_ids;
+    for (uint64_t i{0}; i < removed_ids.size(); ++i) {
+        const civ::ID id = scene.objects.emplace_back();
+        scene.objects[id] = id;
+        reused_ids.push_back(id);
+    }
+    std::sort(removed_ids.begin(), removed_ids.end());
+    std::sort(reused_ids.begin(), reused_ids.end());
+    check(reused_ids == removed_ids && scene.objects.data.size() == slots_count, name + ": removed ids are reused");
+    // Objects created on reused ids must not revive the old references
+    checkReferences(scene, removed_ids, name + " after reuse");
+    check(!scene.objects.hasIndexOverflow(), name + ": no index overflow");
+}
+
+// Marks one object out of period, none if period is 0, plus runs at the start and the end
+std::vector<uint8_t> getMarks(uint64_t count, uint64_t period, uint64_t first_run, uint64_t last_run)
+{
+    std::vector<uint8_t> marked(count, 0);
+    for (uint64_t i{0}; i < count; ++i) {
+        marked[i] = (period && i % period == 0) || i < first_run || i + last_run >= count;
+    }
+    return marked;
+}
+
+}
+
+
+int main()
+{
+    constexpr uint64_t count = 1000;
+    testRemoval(count, getMarks(count, 3, 0, 0), "every third object");
+    testRemoval(count, getMarks(count, 7, 50, 0), "leading run");
+    testRemoval(count, getMarks(count, 5, 0, 100), "trailing run");
+    testRemoval(count, getMarks(count, 0, 0, 1), "last object only");
+    testRemoval(count, std::vector<uint8_t>(count, 0), "nothing marked");
+    testRemoval(count, std::vector<uint8_t>(count, 1), "everything marked");
+    return test::report();
+}
@@ -0,0 +1,158 @@
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "check.hpp"
+#include "metrics/metrics_server.hpp"
+
+
+// Scrapes MetricsServer over a Unix socket like a Prometheus scraper would, while the solver
+// is idle and while it updates on another thread.
+
+namespace
+{
+
+using test::check;
+
+// Sends the request in parts, returns the whole response or an empty string
+std::string scrape(const std::string& path, const std::vector<std::string>& request_parts)
+{
+    const int32_t fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return {};
+    }
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    std::copy(path.begin(), path.end(), address.sun_path);
+    // A server that never answers fails the test instead of blocking it
+    timeval timeout{5, 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    if (connect(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) < 0) {
+        close(fd);
+        return {};
+    }
+    for (const std::string& part : request_parts) {
+        send(fd, part.data(), part.size(), 0);
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    std::string response;
+    char buffer[4096];
+    ssize_t received;
+    while ((received = recv(fd, buffer, sizeof(buffer), 0)) > 0) {
+        response.append(buffer, static_cast<size_t>(received));
+    }
+    close(fd);
+    return response;
+}
+
+std::string scrape(const std::string& path)
+{
+    return scrape(path, {"GET /metrics HTTP/1.1\r\nHost: localhost\r\n\r\n"});
+}
+
+// Value of an unlabeled sample, -1 if missing
+double getSample(const std::string& response, const std::string& name)
+{
+    const std::string key = "\n" + name + " ";
+    const auto position = response.find(key);
+    if (position == std::string::npos) {
+        return -1.0;
+    }
+    return std::stod(response.substr(position + key.size()));
+}
+
+void checkResponse(const std::string& response)
+{
+    check(response.rfind("HTTP/1.0 200 OK\r\n", 0) == 0, "status line");
+    const auto body_start = response.find("\r\n\r\n");
+    const auto length     = response.find("Content-Length: ");
+    check(body_start != std::string::npos && length != std::string::npos &&
+          std::stoul(response.substr(length + 16)) == response.size() - body_start - 4, "content length matches the body");
+    for (const char* type : {"# TYPE verlet_objects gauge", "# TYPE verlet_update_duration_seconds summary",
+                             "# TYPE verlet_worker_busy_seconds_total counter", "# TYPE verlet_contacts_tested_total counter"}) {
+        check(response.find(type) != std::string::npos, std::string{"metric declared: "} + type);
+    }
+}
+
+// Slow updates followed by fast ones, the quantiles have to forget the slow ones
+void testUpdateWindow(tp::ThreadPool& thread_pool)
+{
+    PhysicSolver  solver{{10, 10}, thread_pool};
+    MetricsServer metrics{thread_pool};
+    solver.last_update_ms = 100.0f;
+    for (uint64_t i{0}; i < MetricsServer::update_window; ++i) {
+        metrics.publish(solver);
+    }
+    check(std::abs(getSample(metrics.render(), "verlet_update_duration_seconds{quantile=\"0.5\"}") - 0.1) < 0.002, "slow updates measured");
+    solver.last_update_ms = 1.0f;
+    for (uint64_t i{0}; i < 2 * MetricsServer::update_window; ++i) {
+        metrics.publish(solver);
+    }
+    const std::string response = metrics.render();
+    check(std::abs(getSample(response, "verlet_update_duration_seconds{quantile=\"0.999\"}") - 0.001) < 2e-5, "slow updates left the window");
+    check(getSample(response, "verlet_update_duration_seconds_count") == to<double>(3 * MetricsServer::update_window), "count covers all updates");
+}
+
+}
+
+
+int main()
+{
+    const std::string path = "/tmp/verlet_metrics_test_" + std::to_string(getpid()) + ".sock";
+    tp::ThreadPool thread_pool{2};
+    PhysicSolver   solver{{100, 100}, thread_pool};
+    Emitter emitter;
+    emitter.position = {2.0f, 50.0f};
+    emitter.size     = {0.0f, -20.0f};
+    emitter.rate     = 600.0f;
+    emitter.velocity = {20.0f, 0.0f};
+    solver.emitters.push_back(emitter);
+
+    MetricsServer metrics{thread_pool};
+    if (!metrics.listenUnix(path)) {
+        std::cout << "FAILED: cannot listen on " << path << std::endl;
+        return 1;
+    }
+    metrics.attach(solver);
+
+    // Idle solver, the scrape reflects the last update exactly
+    for (uint32_t i{0}; i < 30; ++i) {
+        solver.update(1.0f / 60.0f);
+    }
+    const std::string response = scrape(path);
+    checkResponse(response);
+    check(getSample(response, "verlet_objects") == to<double>(solver.objects.size()), "objects count");
+    check(getSample(response, "verlet_update_duration_seconds_count") == 30.0, "updates count");
+    check(getSample(response, "verlet_sub_steps") == to<double>(solver.sub_steps), "sub steps");
+    check(response.find("verlet_worker_busy_seconds_total{worker=\"1\"}") != std::string::npos, "one sample per worker");
+
+    // Headers received in several parts
+    const std::string split = scrape(path, {"GET /metrics HTTP/1.1\r\n", "Host: localhost\r\n", "\r\n"});
+    check(getSample(split, "verlet_update_duration_seconds_count") == 30.0, "request received in parts");
+
+    // Scrapes while the solver updates, counters never go back
+    std::atomic<bool> running = true;
+    std::thread updates{[&] {
+        while (running) {
+            solver.update(1.0f / 60.0f);
+        }
+    }};
+    double last_count = 30.0;
+    for (uint32_t i{0}; i < 20; ++i) {
+        const std::string concurrent = scrape(path);
+        checkResponse(concurrent);
+        const double count = getSample(concurrent, "verlet_update_duration_seconds_count");
+        check(count >= last_count, "updates count is monotonic");
+        last_count = count;
+    }
+    running = false;
+    updates.join();
+    metrics.stop();
+
+    testUpdateWindow(thread_pool);
+    return test::report();
+}
@@ -0,0 +1,201 @@
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <iostream>
+#include <thread>
+#include <unistd.h>
+#include "check.hpp"
+#include "shared_memory/particle_export.hpp"
+#include "shared_memory/particle_export_reader.hpp"
+
+
+// Checks that ParticleExportReader never returns a torn frame, a frame mixing data of two
+// publications, and that readers behave when the export is created again over a previous one.
+// Every value of the nth published frame is n, a validated frame must only contain its id.
+
+namespace
+{
+
+using test::check;
+
+struct Publisher
+{
+    ParticleExport particle_export;
+    ParticleFrame  frame;
+    uint64_t       published = 0;
+
+    Publisher(tp::ThreadPool& thread_pool, uint32_t capacity, uint32_t slots_count)
+        : particle_export{thread_pool, capacity, slots_count}
+    {
+        frame.positions.resize(capacity);
+        frame.colors.resize(capacity);
+    }
+
+    bool create(const std::string& name)
+    {
+        published = 0;
+        return particle_export.create(name, {100.0f, 100.0f});
+    }
+
+    void publish()
+    {
+        ++published;
+        const float value = to<float>(published);
+        std::fill(frame.positions.begin(), frame.positions.end(), Vec2{value, value});
+        std::fill(frame.colors.begin(), frame.colors.end(), sf::Color{to<uint32_t>(published)});
+        particle_export.publish(frame);
+    }
+};
+
+bool isConsistent(const ParticleExportReader::FrameView& view)
+{
+    const float value = to<float>(view.frame_id);
+    for (uint32_t i{0}; i < view.objects_count; ++i) {
+        if (view.positions[2 * i] != value || view.positions[2 * i + 1] != value || view.colors[i] != view.frame_id) {
+            return false;
+        }
+    }
+    return true;
+}
+
+struct ReadStats
+{
+    uint64_t valid     = 0;
+    uint64_t discarded = 0;
+    uint64_t torn      = 0;
+
+    void read(ParticleExportReader& reader)
+    {
+        ParticleExportReader::FrameView view;
+        if (!reader.acquire(view)) {
+            return;
+        }
+        const bool consistent = isConsistent(view);
+        if (!reader.validate(view)) {
+            ++discarded;
+        } else if (consistent) {
+            ++valid;
+        } else {
+            ++torn;
+        }
+    }
+};
+
+void testConcurrentReads(tp::ThreadPool& thread_pool, const std::string& name)
+{
+    // Two slots, the writer reuses the slot being read as often as possible
+    Publisher publisher{thread_pool, 20000, 2};
+    check(publisher.create(name), "export created");
+    ParticleExportReader reader;
+    check(reader.open(name), "reader opened");
+
+    std::atomic<bool> done = false;
+    ReadStats stats;
+    std::thread consumer{[&] {
+        while (!done) {
+            stats.read(reader);
+        }
+    }};
+    for (uint32_t i{0}; i < 3000; ++i) {
+        publisher.publish();
+    }
+    done = true;
+    consumer.join();
+    std::cout << "Concurrent reads: " << stats.valid << " valid, " << stats.discarded << " discarded, " << stats.torn << " torn" << std::endl;
+    check(stats.torn == 0, "no torn frame is validated");
+    check(stats.valid > 0, "frames are read while the writer publishes");
+}
+
+void testLeftoverObject(tp::ThreadPool& thread_pool, const std::string& name)
+{
+    // Object left by a crashed writer, with a valid magic over an incomplete layout
+    const int32_t fd = shm_open(name.c_str(), O_CREAT | O_RDWR, 0644);
+    check(fd >= 0 && ftruncate(fd, 4096) == 0, "leftover object created");
+    void* mapping = mmap(nullptr, 4096, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    check(mapping != MAP_FAILED, "leftover object mapped");
+    std::fill_n(static_cast<uint8_t*>(mapping), 4096, uint8_t{0xAB});
+    const uint32_t magic = particle_export::magic;
+    std::memcpy(mapping, &magic, sizeof(magic));
+    munmap(mapping, 4096);
+
+    Publisher publisher{thread_pool, 1000, 4};
+    check(publisher.create(name), "export created over a leftover object");
+    ParticleExportReader reader;
+    check(reader.open(name), "reader opened the new export");
+    check(reader.getHeader()->capacity == 1000 && reader.getHeader()->slots_count == 4, "layout of the new export");
+    ParticleExportReader::FrameView view;
+    check(!reader.acquire(view), "no frame before the first publication");
+    publisher.publish();
+    check(reader.acquire(view) && view.frame_id == 1 && isConsistent(view), "first frame of the new export");
+}
+
+void testRecreation(tp::ThreadPool& thread_pool, const std::string& name)
+{
+    Publisher publisher{thread_pool, 1000, 4};
+    check(publisher.create(name), "first export created");
+    ParticleExportReader old_reader;
+    check(old_reader.open(name), "reader opened the first export");
+    for (uint32_t i{0}; i < 10; ++i) {
+        publisher.publish();
+    }
+    ParticleExportReader::FrameView view;
+    check(old_reader.acquire(view) && view.frame_id == 10, "last frame of the first export");
+
+    // Frame ids start over, the reader of the previous object must not see the new frames
+    check(publisher.create(name), "export created again");
+    for (uint32_t i{0}; i < 3; ++i) {
+        publisher.publish();
+    }
+    check(!old_reader.acquire(view), "reader of the previous object gets no frame");
+    ParticleExportReader reader;
+    check(reader.open(name), "reader opened the new export");
+    check(reader.acquire(view) && view.frame_id == 3 && isConsistent(view), "latest frame of the new export");
+    check(old_reader.open(name) && old_reader.acquire(view) && view.frame_id == 3, "reopened reader gets the new frames");
+}
+
+void testConcurrentRecreation(tp::ThreadPool& thread_pool, const std::string& name)
+{
+    std::atomic<bool> done = false;
+    ReadStats stats;
+    uint64_t  opened = 0;
+    std::thread consumer{[&] {
+        ParticleExportReader reader;
+        while (!done) {
+            if (!reader.open(name)) {
+                continue;
+            }
+            ++opened;
+            for (uint32_t i{0}; i < 100; ++i) {
+                stats.read(reader);
+            }
+        }
+    }};
+    Publisher publisher{thread_pool, 5000, 2};
+    for (uint32_t i{0}; i < 100; ++i) {
+        check(publisher.create(name), "export created");
+        for (uint32_t j{0}; j < 20; ++j) {
+            publisher.publish();
+        }
+    }
+    done = true;
+    consumer.join();
+    std::cout << "Recreation: " << opened << " opened, " << stats.valid << " valid, " << stats.discarded << " discarded, "
+              << stats.torn << " torn" << std::endl;
+    check(stats.torn == 0, "no torn frame while the export is created again");
+}
+
+}
+
+
+int main()
+{
+    tp::ThreadPool thread_pool{2};
+    const std::string name = "/verlet_export_test_" + std::to_string(getpid());
+    testConcurrentReads(thread_pool, name);
+    testLeftoverObject(thread_pool, name);
+    testRecreation(thread_pool, name);
+    testConcurrentRecreation(thread_pool, name);
+    shm_unlink(name.c_str());
+    return test::report();
+}
@@ -0,0 +1,98 @@
+#include <string>
+#include <vector>
+#include "check.hpp"
+#include "engine/common/number_generator.hpp"
+#include "engine/common/rans_coder.hpp"
+
+
+// Encodes and decodes byte streams of various sizes and distributions with RansCoder, and feeds
+// the decoder with truncated or inconsistent data.
+
+namespace
+{
+
+using test::check;
+
+// Symbol i appears about twice as often as symbol i + 1, like the low bytes of small deltas
+std::vector<uint8_t> getSkewed(uint32_t size, uint32_t stream)
+{
+    const CounterRNG rng{5, stream};
+    std::vector<uint8_t> values(size);
+    for (uint32_t i{0}; i < size; ++i) {
+        uint8_t symbol = 0;
+        while (symbol < 255 && rng.get(i, symbol) < 0.5f) {
+            ++symbol;
+        }
+        values[i] = symbol;
+    }
+    return values;
+}
+
+std::vector<uint8_t> getUniform(uint32_t size, uint32_t stream)
+{
+    const CounterRNG rng{5, stream};
+    std::vector<uint8_t> values(size);
+    for (uint32_t i{0}; i < size; ++i) {
+        values[i] = static_cast<uint8_t>(rng.getBlock(i)[0]);
+    }
+    return values;
+}
+
+// Returns the encoded size
+uint64_t testRoundTrip(const std::vector<uint8_t>& input, const std::string& name)
+{
+    // Data already in the output is kept
+    std::vector<uint8_t> encoded{1, 2, 3};
+    RansCoder::encode(input.data(), static_cast<uint32_t>(input.size()), encoded);
+    check(encoded[0] == 1 && encoded[1] == 2 && encoded[2] == 3, name + ": output appended");
+    std::vector<uint8_t> decoded(input.size());
+    const bool success = RansCoder::decode(encoded.data() + 3, static_cast<uint32_t>(encoded.size() - 3), decoded.data(), static_cast<uint32_t>(decoded.size()));
+    check(success && decoded == input, name + ": decoded data matches");
+    return encoded.size() - 3;
+}
+
+void testRoundTrips()
+{
+    testRoundTrip({}, "empty");
+    testRoundTrip({42}, "single byte");
+    testRoundTrip(std::vector<uint8_t>(10000, 7), "single symbol");
+    testRoundTrip({0, 255, 0, 255, 128}, "few symbols");
+    std::vector<uint8_t> all_symbols(256);
+    for (uint32_t s{0}; s < 256; ++s) {
+        all_symbols[s] = static_cast<uint8_t>(s);
+    }
+    testRoundTrip(all_symbols, "every symbol once");
+    // Rare symbols get more than their share of the scale, frequent ones give it back
+    std::vector<uint8_t> rare_symbols = getUniform(300, 1);
+    rare_symbols.resize(100000, 0);
+    testRoundTrip(rare_symbols, "many rare symbols");
+    const uint64_t uniform_size = testRoundTrip(getUniform(100000, 2), "uniform");
+    const uint64_t skewed_size  = testRoundTrip(getSkewed(100000, 3), "skewed");
+    // About 1 byte per uniform symbol and 2 bits per skewed one
+    check(uniform_size < 100000 + 1024, "uniform data is not expanded");
+    check(skewed_size < 100000 / 4 + 1024, "skewed data is compressed close to its entropy");
+}
+
+void testMalformed()
+{
+    const std::vector<uint8_t> input = getSkewed(5000, 4);
+    std::vector<uint8_t> encoded;
+    RansCoder::encode(input.data(), static_cast<uint32_t>(input.size()), encoded);
+    std::vector<uint8_t> decoded(input.size());
+    const auto size = static_cast<uint32_t>(decoded.size());
+    check(!RansCoder::decode(encoded.data(), RansCoder::table_size, decoded.data(), size), "missing state rejected");
+    check(!RansCoder::decode(encoded.data(), static_cast<uint32_t>(encoded.size()) / 2, decoded.data(), size), "truncated stream rejected");
+    std::vector<uint8_t> wrong_table = encoded;
+    ++wrong_table[0];
+    check(!RansCoder::decode(wrong_table.data(), static_cast<uint32_t>(wrong_table.size()), decoded.data(), size), "frequencies not summing to the scale rejected");
+}
+
+}
+
+
+int main()
+{
+    testRoundTrips();
+    testMalformed();
+    return test::report();
+}
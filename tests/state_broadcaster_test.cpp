@@ -0,0 +1,125 @@
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "check.hpp"
+#include "broadcast/state_broadcaster.hpp"
+
+
+// Connects to StateBroadcaster like an external viewer: the rate message is sent in two parts and
+// must still limit the frames received. A server stopped before being attached must release its
+// socket.
+
+namespace
+{
+
+using test::check;
+
+// Lowest free file descriptor, it changes if a descriptor leaks
+int32_t getFreeDescriptor()
+{
+    const int32_t fd = dup(0);
+    close(fd);
+    return fd;
+}
+
+void testStopWithoutAttach(const std::string& path)
+{
+    const int32_t free_fd = getFreeDescriptor();
+    {
+        StateBroadcaster broadcaster;
+        check(broadcaster.listenUnix(path), "broadcaster listening");
+        check(access(path.c_str(), F_OK) == 0, "socket file created");
+        broadcaster.stop();
+        check(access(path.c_str(), F_OK) != 0, "socket file removed without attach");
+    }
+    check(getFreeDescriptor() == free_fd, "no descriptor left open without attach");
+}
+
+int32_t connectTo(const std::string& path)
+{
+    const int32_t fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    std::copy(path.begin(), path.end(), address.sun_path);
+    timeval timeout{0, 300000};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    if (connect(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Frames in the stream after the file header, until nothing is received for a while
+uint32_t countFrames(int32_t fd)
+{
+    std::vector<uint8_t> stream;
+    uint8_t buffer[4096];
+    ssize_t received;
+    while ((received = recv(fd, buffer, sizeof(buffer), 0)) > 0) {
+        stream.insert(stream.end(), buffer, buffer + received);
+    }
+    uint32_t frames = 0;
+    uint64_t offset = sizeof(TrajectoryCodec::FileHeader);
+    TrajectoryCodec::FrameHeader header{};
+    while (offset + sizeof(header) <= stream.size()) {
+        std::memcpy(&header, stream.data() + offset, sizeof(header));
+        if (header.magic != TrajectoryCodec::frame_magic) {
+            break;
+        }
+        offset += sizeof(header) + header.compressed_size;
+        ++frames;
+    }
+    return frames;
+}
+
+void testSplitRate(const std::string& path)
+{
+    tp::ThreadPool   thread_pool{2};
+    PhysicSolver     solver{{100, 100}, thread_pool};
+    FrameCapture     capture{solver, thread_pool};
+    StateBroadcaster broadcaster;
+    check(broadcaster.listenUnix(path), "broadcaster listening");
+    broadcaster.attach(capture, {100.0f, 100.0f});
+    const int32_t fd = connectTo(path);
+    check(fd >= 0, "client connected");
+    if (fd < 0) {
+        return;
+    }
+    // One frame per second, sent in two parts
+    const uint32_t rate = 1;
+    const auto*    rate_bytes = reinterpret_cast<const uint8_t*>(&rate);
+    send(fd, rate_bytes, 2, 0);
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    send(fd, rate_bytes + 2, 2, 0);
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+    auto frame = std::make_shared<ParticleFrame>();
+    frame->positions = {{10.0f, 10.0f}, {20.0f, 30.0f}};
+    frame->colors    = {sf::Color::Red, sf::Color::Blue};
+    frame->ids       = {0, 1};
+    for (uint32_t i{0}; i < 10; ++i) {
+        frame->frame_id = i;
+        broadcaster.publish(std::make_shared<const ParticleFrame>(*frame));
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    }
+    check(countFrames(fd) == 1, "rate received in parts limits the frames");
+    close(fd);
+    broadcaster.stop();
+}
+
+}
+
+
+int main()
+{
+    const std::string path = "/tmp/verlet_broadcast_test_" + std::to_string(getpid()) + ".sock";
+    testStopWithoutAttach(path);
+    testSplitRate(path);
+    return test::report();
+}
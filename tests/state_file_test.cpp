@@ -0,0 +1,122 @@
+#include <cstdio>
+#include <limits>
+#include <string>
+#include <utility>
+#include "check.hpp"
+#include "physics/state_file.hpp"
+
+
+// Saves and loads solver states, including states whose ids were broken before saving: the checksum
+// matches such files, the load has to reject them from their content.
+
+namespace
+{
+
+using test::check;
+
+const std::string path = "verlet_state_file_test.bin";
+
+void createScene(PhysicSolver& solver)
+{
+    for (uint32_t i{0}; i < 50; ++i) {
+        solver.createObject({10.0f + to<float>(i % 10) * 2.0f, 10.0f + to<float>(i / 10) * 2.0f});
+    }
+    // Leaves free slots past the objects count
+    std::vector<uint8_t> marked(solver.objects.size(), 0);
+    for (uint32_t i{0}; i < marked.size(); i += 3) {
+        marked[i] = 1;
+    }
+    solver.objects.remove_marked(marked);
+}
+
+bool load(tp::ThreadPool& thread_pool)
+{
+    PhysicSolver solver{{20, 20}, thread_pool};
+    return StateFile::load(solver, path);
+}
+
+void testRoundTrip(tp::ThreadPool& thread_pool)
+{
+    PhysicSolver solver{{60, 40}, thread_pool};
+    createScene(solver);
+    check(StateFile::save(solver, path), "state saved");
+    PhysicSolver loaded{{20, 20}, thread_pool};
+    loaded.objects.index_overflow = true;
+    check(StateFile::load(loaded, path), "state loaded");
+    check(loaded.grid.width == 60 && loaded.grid.height == 40, "world size loaded");
+    check(loaded.objects.size() == solver.objects.size(), "objects count loaded");
+    bool same = true;
+    for (uint64_t i{0}; i < solver.objects.data.size(); ++i) {
+        same &= loaded.objects.ids[i] == solver.objects.ids[i] && loaded.objects.getID(i) == solver.objects.getID(i);
+    }
+    check(same, "ids loaded");
+    check(!loaded.objects.hasIndexOverflow(), "index overflow of the previous objects cleared");
+}
+
+void testCorruptedIds(tp::ThreadPool& thread_pool)
+{
+    PhysicSolver solver{{60, 40}, thread_pool};
+    createScene(solver);
+    auto& objects = solver.objects;
+    const auto id = objects.ids[3];
+    objects.ids[3] = to<ObjectIndex>(objects.data.size());
+    check(StateFile::save(solver, path) && !load(thread_pool), "id out of the slots rejected");
+    objects.ids[3] = objects.ids[4];
+    check(StateFile::save(solver, path) && !load(thread_pool), "duplicated id rejected");
+    objects.ids[3] = id;
+    std::swap(objects.ids[3], objects.ids[4]);
+    const bool swapped_loaded = StateFile::save(solver, path) && load(thread_pool);
+    std::swap(objects.ids[3], objects.ids[4]);
+    check(!swapped_loaded, "ids not matching their slots rejected");
+
+    objects.metadata[5].rid = to<ObjectIndex>(objects.data.size() + 10);
+    check(StateFile::save(solver, path) && !load(thread_pool), "reverse id out of the slots rejected");
+}
+
+void testWorldSize(tp::ThreadPool& thread_pool)
+{
+    PhysicSolver solver{{60, 40}, thread_pool};
+    createScene(solver);
+    // Only the header's dimensions are saved, the grid itself is not allocated
+    solver.grid.width  = 1 << 14;
+    solver.grid.height = 1 << 14;
+    check(StateFile::save(solver, path) && !load(thread_pool), "oversized world rejected");
+}
+
+// Only compact objects can overflow their index, the operation counter is moved close to the limit
+void testIndexOverflow(tp::ThreadPool& thread_pool)
+{
+    constexpr uint64_t max_index = decltype(PhysicSolver::objects)::max_index;
+    if constexpr (max_index < std::numeric_limits<uint64_t>::max()) {
+        PhysicSolver solver{{60, 40}, thread_pool};
+        createScene(solver);
+        solver.objects.op_count = max_index;
+        check(solver.checkIndexOverflow(), "no overflow below the limit");
+        solver.createObject({30.0f, 30.0f});
+        solver.createObject({32.0f, 30.0f});
+        check(!solver.checkIndexOverflow(), "overflow detected on creation");
+
+        Emitter emitter;
+        emitter.position = {20.0f, 20.0f};
+        emitter.rate     = 100.0f;
+        const uint64_t objects_count = solver.objects.size();
+        solver.emitObjects(emitter, 0.1f);
+        check(solver.objects.size() == objects_count, "no emission after the overflow");
+
+        check(StateFile::save(solver, path) && !load(thread_pool), "overflowed state rejected");
+    }
+}
+
+}
+
+
+int main()
+{
+    tp::ThreadPool thread_pool{2};
+    testRoundTrip(thread_pool);
+    testCorruptedIds(thread_pool);
+    testWorldSize(thread_pool);
+    testIndexOverflow(thread_pool);
+    std::remove(path.c_str());
+    return test::report();
+}
@@ -0,0 +1,126 @@
+#include <cmath>
+#include <vector>
+#include "check.hpp"
+#include "physics/physics.hpp"
+
+
+// Changes the sub steps count in the middle of a run, explicitly and from the adaptive mode, and
+// checks that objects keep their velocity: Verlet velocities are displacements per sub step, the
+// implied velocity (position - last_position) / sub_dt must not jump when sub_dt changes.
+
+namespace
+{
+
+using test::check;
+
+constexpr float dt = 1.0f / 60.0f;
+
+// Objects far enough from each other and from the borders to never collide, no gravity
+void createScene(PhysicSolver& solver)
+{
+    solver.gravity = {0.0f, 0.0f};
+    const float sub_dt = dt / to<float>(solver.sub_steps);
+    for (uint32_t i{0}; i < 20; ++i) {
+        const uint64_t id = solver.createObject({100.0f + 10.0f * to<float>(i % 5), 100.0f + 10.0f * to<float>(i / 5)});
+        const Vec2 velocity{10.0f + 2.0f * to<float>(i), 30.0f - 3.0f * to<float>(i)};
+        solver.objects[id].addVelocity(velocity * sub_dt);
+    }
+}
+
+std::vector<Vec2> getVelocities(const PhysicSolver& solver)
+{
+    const float sub_dt = dt / to<float>(solver.sub_steps);
+    std::vector<Vec2> velocities;
+    for (const PhysicObject& object : solver.objects) {
+        velocities.push_back(object.getVelocity() / sub_dt);
+    }
+    return velocities;
+}
+
+std::vector<Vec2> getPositions(const PhysicSolver& solver)
+{
+    std::vector<Vec2> positions;
+    for (const PhysicObject& object : solver.objects) {
+        positions.push_back(object.position);
+    }
+    return positions;
+}
+
+// Largest difference between two velocities relative to the first one's norm
+float getMaxRelativeError(const std::vector<Vec2>& reference, const std::vector<Vec2>& values)
+{
+    float max_error = 0.0f;
+    for (uint32_t i{0}; i < reference.size(); ++i) {
+        max_error = std::max(max_error, MathVec2::length(values[i] - reference[i]) / MathVec2::length(reference[i]));
+    }
+    return max_error;
+}
+
+void testExplicitChange()
+{
+    tp::ThreadPool thread_pool{2};
+    PhysicSolver   solver{{300, 300}, thread_pool};
+    createScene(solver);
+    for (uint32_t frame{0}; frame < 10; ++frame) {
+        solver.update(dt);
+    }
+    for (const uint32_t count : {13u, 5u, 32u, 1u, 8u}) {
+        const std::vector<Vec2> before = getVelocities(solver);
+        solver.setSubSteps(count);
+        check(solver.sub_steps == count, "sub steps count set");
+        check(getMaxRelativeError(before, getVelocities(solver)) < 1e-3f, "velocities kept when the sub steps count changes to " + std::to_string(count));
+        // The next frame moves objects by the same distance as the previous one, up to the damping
+        solver.update(dt);
+        const std::vector<Vec2> start = getPositions(solver);
+        solver.update(dt);
+        const std::vector<Vec2> end = getPositions(solver);
+        std::vector<Vec2> moves;
+        for (uint32_t i{0}; i < start.size(); ++i) {
+            moves.push_back((end[i] - start[i]) / dt);
+        }
+        check(getMaxRelativeError(before, moves) < 0.05f, "objects keep their speed after the change to " + std::to_string(count));
+    }
+}
+
+void testAdaptiveChange()
+{
+    tp::ThreadPool thread_pool{2};
+    PhysicSolver   solver{{300, 300}, thread_pool};
+    // Objects travel more than allowed per sub step, the count has to grow over several frames
+    solver.adaptive.enabled          = true;
+    solver.adaptive.max_displacement = 0.02f;
+    createScene(solver);
+    const uint32_t initial_count = solver.sub_steps;
+    std::vector<Vec2> last_positions = getPositions(solver);
+    std::vector<Vec2> last_moves;
+    uint32_t changes = 0;
+    uint32_t last_count = solver.sub_steps;
+    float max_error = 0.0f;
+    for (uint32_t frame{0}; frame < 30; ++frame) {
+        solver.update(dt);
+        const std::vector<Vec2> positions = getPositions(solver);
+        std::vector<Vec2> moves;
+        for (uint32_t i{0}; i < positions.size(); ++i) {
+            moves.push_back(positions[i] - last_positions[i]);
+        }
+        if (!last_moves.empty()) {
+            max_error = std::max(max_error, getMaxRelativeError(last_moves, moves));
+        }
+        changes   += solver.sub_steps != last_count;
+        last_count = solver.sub_steps;
+        last_positions = positions;
+        last_moves     = moves;
+    }
+    check(changes > 1 && solver.sub_steps > initial_count, "adaptive mode changed the sub steps count");
+    check(max_error < 0.01f, "displacement per frame is continuous across adaptive changes");
+}
+
+}
+
+
+int main()
+{
+    testExplicitChange();
+    testAdaptiveChange();
+    return test::report();
+}
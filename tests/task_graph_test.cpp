@@ -0,0 +1,116 @@
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+#include "check.hpp"
+#include "physics/physics.hpp"
+
+
+// Runs the same seeded pile with UpdateMode::TaskGraph and UpdateMode::Barrier. Both solve the
+// same stripes in the same order, the graph only removes the barriers, so objects must end up
+// exactly at the same positions. Graph tasks are randomly delayed so that a missing dependency
+// lets stripes run in another order and breaks the equality.
+
+namespace
+{
+
+using test::check;
+
+constexpr float dt = 1.0f / 60.0f;
+// Not a multiple of the stripes count, the remaining cells form an extra stripe
+const IVec2 world_size{125, 40};
+
+struct Result
+{
+    std::vector<Vec2> positions;
+    SolverHealth      health;
+};
+
+// Randomly holds back a quarter of the sub step graph's task executions to shuffle their completion order
+void addDelays(PhysicSolver& solver)
+{
+    solver.buildSubStepGraph();
+    std::vector<tp::TaskGraph::Node>& nodes = solver.sub_step_graph.m_nodes;
+    for (uint32_t i{0}; i < nodes.size(); ++i) {
+        auto executions = std::make_shared<std::atomic<uint64_t>>(0);
+        nodes[i].task = [task = std::move(nodes[i].task), executions, i]{
+            const CounterRNG rng{11, i};
+            if (rng.get((*executions)++) < 0.25f) {
+                std::this_thread::sleep_for(std::chrono::milliseconds{1});
+            }
+            task();
+        };
+    }
+}
+
+// Seeded emission into a box, objects fall and pile up on the floor, the pile is still moving
+std::vector<PhysicObject> createPile()
+{
+    tp::ThreadPool thread_pool{4};
+    PhysicSolver   solver{world_size, thread_pool};
+    Emitter emitter;
+    emitter.shape             = Emitter::Shape::Box;
+    emitter.position          = {5.0f, 5.0f};
+    emitter.size              = {115.0f, 15.0f};
+    emitter.rate              = 6000.0f;
+    emitter.velocity          = {5.0f, 0.0f};
+    emitter.velocity_jitter   = 20.0f;
+    emitter.seed              = 7;
+    emitter.max_objects_count = 3000;
+    solver.emitters           = {emitter};
+    for (uint32_t frame{0}; frame < 150; ++frame) {
+        solver.update(dt);
+    }
+    return {solver.objects.begin(), solver.objects.end()};
+}
+
+Result run(const std::vector<PhysicObject>& pile, UpdateMode mode, uint32_t threads_count, uint32_t tasks_per_thread)
+{
+    tp::ThreadPool thread_pool{threads_count};
+    PhysicSolver   solver{world_size, thread_pool};
+    solver.mode = mode;
+    solver.setCollisionTasksPerThread(tasks_per_thread);
+    if (mode == UpdateMode::TaskGraph) {
+        addDelays(solver);
+    }
+    for (const PhysicObject& object : pile) {
+        solver.addObject(object);
+    }
+    for (uint32_t frame{0}; frame < 10; ++frame) {
+        solver.update(dt);
+    }
+    Result result;
+    for (const PhysicObject& object : solver.objects) {
+        result.positions.push_back(object.position);
+    }
+    result.health = solver.health;
+    return result;
+}
+
+void testSameAsBarrier(const std::vector<PhysicObject>& pile, uint32_t threads_count, uint32_t tasks_per_thread)
+{
+    const std::string configuration = std::to_string(threads_count) + " threads, " + std::to_string(tasks_per_thread) + " tasks per thread";
+    const Result barrier = run(pile, UpdateMode::Barrier, threads_count, tasks_per_thread);
+    const Result graph   = run(pile, UpdateMode::TaskGraph, threads_count, tasks_per_thread);
+    bool same = graph.positions.size() == barrier.positions.size();
+    for (uint32_t i{0}; same && i < graph.positions.size(); ++i) {
+        same = graph.positions[i].x == barrier.positions[i].x && graph.positions[i].y == barrier.positions[i].y;
+    }
+    check(same, "task graph matches the barrier mode with " + configuration);
+    check(graph.health.candidates_tested == barrier.health.candidates_tested &&
+          graph.health.contacts_resolved == barrier.health.contacts_resolved &&
+          graph.health.max_penetration == barrier.health.max_penetration, "same contacts as the barrier mode with " + configuration);
+}
+
+}
+
+
+int main()
+{
+    const std::vector<PhysicObject> pile = createPile();
+    check(pile.size() > 2500, "objects are emitted");
+    testSameAsBarrier(pile, 2, 1);
+    testSameAsBarrier(pile, 3, 2);
+    testSameAsBarrier(pile, 4, 3);
+    return test::report();
+}
@@ -0,0 +1,107 @@
+#include <cmath>
+#include <vector>
+#include "check.hpp"
+#include "physics/physics.hpp"
+
+
+// Runs the temporally blocked update on a pile that is still settling and compares owned objects to
+// a single tile covering the whole world, where no halo is involved, and to UpdateMode::Barrier.
+// Tiles must match the single tile exactly, the barrier mode solves contacts in another order and
+// is only expected to stay close.
+
+namespace
+{
+
+using test::check;
+
+constexpr float    dt            = 1.0f / 60.0f;
+constexpr uint32_t threads_count = 4;
+const IVec2        world_size{100, 60};
+
+// Objects thrown from the left side, still moving when the pile is captured
+std::vector<PhysicObject> createPile()
+{
+    tp::ThreadPool thread_pool{threads_count};
+    PhysicSolver   solver{world_size, thread_pool};
+    for (uint32_t frame{0}; frame < 150; ++frame) {
+        for (uint32_t i{0}; i < 10; ++i) {
+            const uint64_t id = solver.createObject({2.0f, 10.0f + 1.1f * to<float>(i)});
+            solver.objects[id].addVelocity({0.3f, 0.0f});
+        }
+        solver.update(dt);
+    }
+    return {solver.objects.begin(), solver.objects.end()};
+}
+
+struct Result
+{
+    std::vector<Vec2> positions;
+    SolverHealth      health;
+};
+
+Result run(const std::vector<PhysicObject>& pile, UpdateMode mode, int32_t tile_width, uint32_t frames)
+{
+    tp::ThreadPool thread_pool{threads_count};
+    PhysicSolver   solver{world_size, thread_pool};
+    solver.mode = mode;
+    solver.temporal_blocking.tile_width = tile_width;
+    for (const PhysicObject& object : pile) {
+        solver.addObject(object);
+    }
+    for (uint32_t frame{0}; frame < frames; ++frame) {
+        solver.update(dt);
+    }
+    Result result;
+    for (const PhysicObject& object : solver.objects) {
+        result.positions.push_back(object.position);
+    }
+    result.health = solver.health;
+    return result;
+}
+
+void testTiles(const std::vector<PhysicObject>& pile)
+{
+    for (const uint32_t frames : {1u, 4u}) {
+        const Result tiles  = run(pile, UpdateMode::TemporalBlocking, 16, frames);
+        const Result single = run(pile, UpdateMode::TemporalBlocking, world_size.x, frames);
+        bool same = tiles.positions.size() == single.positions.size();
+        for (uint32_t i{0}; same && i < tiles.positions.size(); ++i) {
+            same = tiles.positions[i].x == single.positions[i].x && tiles.positions[i].y == single.positions[i].y;
+        }
+        check(same, "tiles match a single tile after " + std::to_string(frames) + " frames");
+        // Halo objects are solved by several tiles but their contacts are only counted by their owner
+        check(tiles.health.candidates_tested == single.health.candidates_tested &&
+              tiles.health.contacts_resolved == single.health.contacts_resolved &&
+              tiles.health.max_penetration == single.health.max_penetration, "tiles count each contact once");
+    }
+}
+
+void testBarrier(const std::vector<PhysicObject>& pile)
+{
+    constexpr uint32_t frames = 1;
+    const Result tiles   = run(pile, UpdateMode::TemporalBlocking, 16, frames);
+    const Result barrier = run(pile, UpdateMode::Barrier, 16, frames);
+    float max_distance  = 0.0f;
+    float mean_distance = 0.0f;
+    for (uint32_t i{0}; i < tiles.positions.size(); ++i) {
+        const float distance = MathVec2::length(tiles.positions[i] - barrier.positions[i]);
+        max_distance   = std::max(max_distance, distance);
+        mean_distance += distance;
+    }
+    mean_distance /= to<float>(tiles.positions.size());
+    check(mean_distance < 0.005f, "owned objects stay close to the barrier mode on average");
+    check(max_distance < 0.1f, "no owned object drifts away from the barrier mode");
+    const auto tested_ratio = to<float>(tiles.health.candidates_tested) / to<float>(barrier.health.candidates_tested);
+    check(std::abs(tested_ratio - 1.0f) < 0.01f, "same contacts tested as the barrier mode");
+}
+
+}
+
+
+int main()
+{
+    const std::vector<PhysicObject> pile = createPile();
+    testTiles(pile);
+    testBarrier(pile);
+    return test::report();
+}
@@ -0,0 +1,70 @@
+#include <iostream>
+#include "check.hpp"
+#include "thread_pool/thread_pool.hpp"
+
+
+// Pins workers with given topologies, one of them naming a CPU that cannot be used: the workers
+// pinned before the failure must get their previous masks back.
+
+namespace
+{
+
+using test::check;
+
+#ifdef VERLET_THREAD_AFFINITY
+// Not online on the machines running the tests, pinning a worker to it fails
+constexpr uint32_t unusable_cpu = CPU_SETSIZE - 1;
+
+bool hasMask(tp::ThreadPool& thread_pool, uint32_t worker, const cpu_set_t& expected)
+{
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    return pthread_getaffinity_np(thread_pool.m_workers[worker].m_thread.native_handle(), sizeof(set), &set) == 0 &&
+           CPU_EQUAL(&set, &expected);
+}
+
+void testRollback()
+{
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    sched_getaffinity(0, sizeof(allowed), &allowed);
+    uint32_t cpu = 0;
+    while (!CPU_ISSET(cpu, &allowed)) {
+        ++cpu;
+    }
+    cpu_set_t single;
+    CPU_ZERO(&single);
+    CPU_SET(cpu, &single);
+
+    tp::ThreadPool thread_pool{2};
+    tp::CpuTopology broken;
+    broken.nodes = {{0, {cpu}}, {1, {unusable_cpu}}};
+    check(!thread_pool.setAffinity(tp::Affinity::Cores, broken), "pinning to an unusable CPU fails");
+    check(!thread_pool.isPinned(), "failed pinning leaves the workers unpinned");
+    check(hasMask(thread_pool, 0, allowed) && hasMask(thread_pool, 1, allowed), "workers keep their previous masks");
+
+    tp::CpuTopology valid;
+    valid.nodes = {{3, {cpu}}};
+    check(thread_pool.setAffinity(tp::Affinity::Cores, valid), "pinning to a usable CPU succeeds");
+    check(hasMask(thread_pool, 0, single) && hasMask(thread_pool, 1, single), "workers pinned");
+    check(thread_pool.getWorkerNode(1) == 3, "workers nodes set");
+
+    check(!thread_pool.setAffinity(tp::Affinity::Nodes, broken), "pinning to an unusable node fails");
+    check(thread_pool.m_affinity == tp::Affinity::Cores, "affinity unchanged by the failure");
+    check(hasMask(thread_pool, 0, single) && hasMask(thread_pool, 1, single), "workers keep their pinning");
+    check(thread_pool.getWorkerNode(0) == 3 && thread_pool.getWorkerNode(1) == 3, "workers nodes unchanged");
+}
+#endif
+
+}
+
+
+int main()
+{
+#ifdef VERLET_THREAD_AFFINITY
+    testRollback();
+#else
+    std::cout << "Thread affinity is not supported on this platform" << std::endl;
+#endif
+    return test::report();
+}
@@ -0,0 +1,173 @@
+#include <cmath>
+#include <string>
+#include <vector>
+#include "check.hpp"
+#include "engine/common/number_generator.hpp"
+#include "recording/trajectory_codec.hpp"
+
+
+// Encodes a changing set of objects with TrajectoryCodec and decodes it back: positions must be
+// within the quantization step, colors exact, including for objects moved to another index by
+// removals, and keyframes must be decodable without the previous frames.
+
+namespace
+{
+
+using test::check;
+
+constexpr uint32_t keyframe_interval = 8;
+constexpr uint32_t frames_count      = 40;
+// Half of the quantization step
+constexpr float    max_error         = 0.5f / static_cast<float>(1 << TrajectoryCodec::fraction_bits);
+
+// Objects drift, some jump far away, objects are removed like civ::Vector does, moving the last
+// ones into the holes, and new ones are appended
+struct Scene
+{
+    ParticleFrame frame;
+    uint64_t      next_id = 0;
+    CounterRNG    rng{3};
+
+    void add(uint32_t count)
+    {
+        for (uint32_t i{0}; i < count; ++i) {
+            const uint64_t id = next_id++;
+            frame.positions.push_back({rng.getRange(0.0f, 1000.0f, id, 0), rng.getRange(0.0f, 1000.0f, id, 1)});
+            const CounterRNG::Block color = rng.getBlock(id, 1);
+            frame.colors.push_back({static_cast<uint8_t>(color[0]), static_cast<uint8_t>(color[1]), static_cast<uint8_t>(color[2]), 255});
+            frame.ids.push_back(to<ObjectIndex>(id));
+        }
+    }
+
+    void remove(uint32_t index)
+    {
+        frame.positions[index] = frame.positions.back();
+        frame.colors[index]    = frame.colors.back();
+        frame.ids[index]       = frame.ids.back();
+        frame.positions.pop_back();
+        frame.colors.pop_back();
+        frame.ids.pop_back();
+    }
+
+    void step(uint32_t frame_index)
+    {
+        const CounterRNG step_rng{4, frame_index};
+        for (uint32_t i{0}; i < frame.size(); ++i) {
+            Vec2& position = frame.positions[i];
+            position.x += step_rng.getRange(-0.3f, 0.3f, i, 0);
+            position.y += step_rng.getRange(-0.3f, 0.3f, i, 1);
+            if (i % 17 == frame_index % 17) {
+                position.x += step_rng.getRange(-300.0f, 300.0f, i, 2);
+            }
+        }
+        // Differences larger than 2^27 steps need the longest varints
+        frame.positions[0].x = (frame_index % 2) ? 100000.0f : -100000.0f;
+        if (frame_index % 10 == 5) {
+            // Fewer objects than the reference
+            for (uint32_t i{0}; i < 200; ++i) {
+                frame.positions.pop_back();
+                frame.colors.pop_back();
+                frame.ids.pop_back();
+            }
+        } else if (frame_index % 10 != 0) {
+            for (const uint32_t index : {3u, 100u + frame_index, 500u}) {
+                remove(index);
+            }
+            add(5);
+        }
+        frame.frame_id = frame_index;
+    }
+};
+
+bool isSame(const ParticleFrame& decoded, const ParticleFrame& expected, float& error)
+{
+    if (decoded.size() != expected.size() || decoded.frame_id != expected.frame_id) {
+        return false;
+    }
+    bool same = true;
+    for (uint32_t i{0}; i < expected.size(); ++i) {
+        error = std::max(error, std::abs(decoded.positions[i].x - expected.positions[i].x));
+        error = std::max(error, std::abs(decoded.positions[i].y - expected.positions[i].y));
+        same &= decoded.colors[i] == expected.colors[i];
+    }
+    return same;
+}
+
+bool decode(TrajectoryCodec& codec, const std::vector<uint8_t>& encoded, ParticleFrame& frame)
+{
+    TrajectoryCodec::FrameHeader header{};
+    std::memcpy(&header, encoded.data(), sizeof(header));
+    std::vector<uint8_t> raw;
+    return header.magic == TrajectoryCodec::frame_magic &&
+           TrajectoryCodec::decodeRaw(header, encoded.data() + sizeof(header), raw) &&
+           codec.applyRaw(header, raw, frame);
+}
+
+void testRoundTrip()
+{
+    Scene scene;
+    scene.add(1000);
+    TrajectoryCodec encoder;
+    std::vector<ParticleFrame>        frames;
+    std::vector<std::vector<uint8_t>> encoded(frames_count);
+    for (uint32_t f{0}; f < frames_count; ++f) {
+        scene.step(f);
+        frames.push_back(scene.frame);
+        encoder.encode(scene.frame, f, f % keyframe_interval == 0, encoded[f]);
+    }
+
+    TrajectoryCodec decoder;
+    ParticleFrame   frame;
+    bool  same  = true;
+    float error = 0.0f;
+    for (uint32_t f{0}; f < frames_count; ++f) {
+        same &= decode(decoder, encoded[f], frame) && isSame(frame, frames[f], error);
+    }
+    check(same, "frames decoded in order match, colors of moved objects included");
+    check(error <= max_error, "positions within half a quantization step, error " + std::to_string(error));
+    check(encoded[1].size() < encoded[0].size() / 2, "delta frames are smaller than keyframes");
+
+    // A keyframe starts a new chain, other frames need the previous ones
+    bool keyframes_decoded = true;
+    bool deltas_rejected   = true;
+    for (uint32_t f{0}; f < frames_count; ++f) {
+        TrajectoryCodec fresh;
+        const bool decoded = decode(fresh, encoded[f], frame);
+        if (f % keyframe_interval == 0) {
+            keyframes_decoded &= decoded && isSame(frame, frames[f], error);
+        } else {
+            deltas_rejected &= !decoded;
+        }
+    }
+    check(keyframes_decoded, "keyframes decoded without the previous frames");
+    check(deltas_rejected, "delta frames rejected without their reference");
+}
+
+void testMalformed()
+{
+    Scene scene;
+    scene.add(100);
+    TrajectoryCodec encoder;
+    std::vector<uint8_t> encoded;
+    encoder.encode(scene.frame, 0, true, encoded);
+    TrajectoryCodec::FrameHeader header{};
+    std::memcpy(&header, encoded.data(), sizeof(header));
+    std::vector<uint8_t> raw;
+    check(TrajectoryCodec::decodeRaw(header, encoded.data() + sizeof(header), raw), "frame decoded");
+    raw.pop_back();
+    TrajectoryCodec decoder;
+    ParticleFrame   frame;
+    check(!decoder.applyRaw(header, raw, frame), "truncated frame rejected");
+    raw.resize(10);
+    check(!decoder.applyRaw(header, raw, frame), "truncated positions rejected");
+}
+
+}
+
+
+int main()
+{
+    testRoundTrip();
+    testMalformed();
+    return test::report();
+}
@@ -0,0 +1,147 @@
+#include <cmath>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+#include "check.hpp"
+#include "recording/trajectory_player.hpp"
+#include "recording/trajectory_recorder.hpp"
+
+
+// Records frames with TrajectoryRecorder and plays them back with TrajectoryPlayer, in order and
+// by seeking to frames before, on and after keyframes.
+
+namespace
+{
+
+using test::check;
+
+const std::string  path              = "verlet_trajectory_player_test.bin";
+constexpr uint32_t keyframe_interval = 8;
+constexpr uint32_t frames_count      = 50;
+constexpr float    max_error         = 0.5f / static_cast<float>(1 << TrajectoryCodec::fraction_bits);
+
+// Objects move on circles, one is removed from the middle every frame and two are appended
+std::vector<ParticleFrame> createFrames()
+{
+    std::vector<ParticleFrame> frames;
+    ParticleFrame frame;
+    uint32_t next_id = 0;
+    for (uint32_t f{0}; f < frames_count; ++f) {
+        if (f) {
+            const uint32_t index = (37 * f) % frame.size();
+            frame.ids[index]    = frame.ids.back();
+            frame.colors[index] = frame.colors.back();
+            frame.ids.pop_back();
+            frame.colors.pop_back();
+        }
+        while (frame.ids.size() < 500 + f) {
+            const uint32_t id = next_id++;
+            frame.ids.push_back(to<ObjectIndex>(id));
+            frame.colors.push_back({static_cast<uint8_t>(id), static_cast<uint8_t>(id * 7), static_cast<uint8_t>(id * 13), 255});
+        }
+        frame.positions.resize(frame.ids.size());
+        for (uint32_t i{0}; i < frame.size(); ++i) {
+            const auto  id    = to<float>(frame.ids[i]);
+            const float angle = 0.05f * to<float>(f) + id;
+            frame.positions[i] = {500.0f + (10.0f + id) * std::cos(angle), 500.0f + (10.0f + id) * std::sin(angle)};
+        }
+        frame.frame_id = f;
+        frames.push_back(frame);
+    }
+    return frames;
+}
+
+bool isSame(const ParticleFrame& decoded, const ParticleFrame& expected)
+{
+    if (decoded.size() != expected.size() || decoded.frame_id != expected.frame_id) {
+        return false;
+    }
+    bool same = true;
+    for (uint32_t i{0}; i < expected.size(); ++i) {
+        same &= std::abs(decoded.positions[i].x - expected.positions[i].x) <= max_error &&
+                std::abs(decoded.positions[i].y - expected.positions[i].y) <= max_error &&
+                decoded.colors[i] == expected.colors[i];
+    }
+    return same;
+}
+
+void record(const std::vector<ParticleFrame>& frames)
+{
+    // Enough slots to never drop a frame
+    TrajectoryRecorder recorder{frames_count, keyframe_interval};
+    recorder.start(path, {1000.0f, 1000.0f});
+    for (const ParticleFrame& frame : frames) {
+        recorder.push(std::make_shared<const ParticleFrame>(frame));
+    }
+    recorder.stop();
+}
+
+void testPlayback(tp::ThreadPool& thread_pool, const std::vector<ParticleFrame>& frames)
+{
+    TrajectoryPlayer player{thread_pool, 4};
+    check(player.open(path), "trajectory opened");
+    check(player.getFramesCount() == frames_count, "all frames indexed");
+    check(player.getFileHeader().keyframe_interval == keyframe_interval, "keyframe interval stored");
+    ParticleFrame frame;
+    bool same = true;
+    for (uint32_t f{0}; f < frames_count; ++f) {
+        same &= player.next(frame) && isSame(frame, frames[f]);
+    }
+    check(same, "frames played in order");
+    check(!player.next(frame), "no frame after the last one");
+}
+
+void testSeek(tp::ThreadPool& thread_pool, const std::vector<ParticleFrame>& frames)
+{
+    TrajectoryPlayer player{thread_pool, 4};
+    check(player.open(path), "trajectory opened");
+    ParticleFrame frame;
+    for (const uint32_t target : {20u, 7u, 8u, 9u, 0u, 49u, 15u, 16u, 33u}) {
+        const bool seeked = player.seek(target, frame) && isSame(frame, frames[target]);
+        check(seeked, "seek to frame " + std::to_string(target));
+        check(player.getNextFrame() == target + 1, "playback resumes after frame " + std::to_string(target));
+        // The prefetched frames following the target are still decoded against the right reference
+        bool same = true;
+        for (uint32_t f{target + 1}; f < std::min(target + 6, frames_count); ++f) {
+            same &= player.next(frame) && isSame(frame, frames[f]);
+        }
+        check(same, "frames after frame " + std::to_string(target));
+    }
+    check(!player.seek(frames_count, frame), "seek past the end rejected");
+}
+
+// An interrupted recording leaves a partial last frame, it is ignored
+void testTruncated(tp::ThreadPool& thread_pool, const std::vector<ParticleFrame>& frames)
+{
+    std::vector<char> content;
+    {
+        std::ifstream file(path, std::ios::binary);
+        content.assign(std::istreambuf_iterator<char>(file), {});
+    }
+    content.resize(content.size() - 10);
+    {
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        file.write(content.data(), static_cast<std::streamsize>(content.size()));
+    }
+    TrajectoryPlayer player{thread_pool, 4};
+    check(player.open(path), "truncated trajectory opened");
+    check(player.getFramesCount() == frames_count - 1, "partial frame ignored");
+    ParticleFrame frame;
+    check(player.seek(frames_count - 2, frame) && isSame(frame, frames[frames_count - 2]), "last complete frame decoded");
+}
+
+}
+
+
+int main()
+{
+    tp::ThreadPool thread_pool{3};
+    const std::vector<ParticleFrame> frames = createFrames();
+    record(frames);
+    testPlayback(thread_pool, frames);
+    testSeek(thread_pool, frames);
+    testTruncated(thread_pool, frames);
+    std::remove(path.c_str());
+    return test::report();
+}